@@ -1,10 +1,13 @@
 #include "bot/first.hpp"
 #include "bot/mcts.hpp"
+#include "bot/turn_timer.hpp"
+#include "bot/watchdog.hpp"
 #include "hlt/game.hpp"
 #include "hlt/log.hpp"
 
 #include <chrono>
 #include <ctime>
+#include <iostream>
 #include <string>
 
 int main(int argc, char* argv[]) {
@@ -12,6 +15,8 @@ int main(int argc, char* argv[]) {
 	unsigned int rng_seed = argc > 1
         ? static_cast<unsigned int>(std::stoul(argv[1]))
         : std::time(nullptr);
+    // Searches a fixed number of iterations each turn if given, for reproducible runs.
+    int max_iterations = argc > 2 ? std::stoi(argv[2]) : 0;
 
     hlt::Game game;
 
@@ -23,17 +28,42 @@ int main(int argc, char* argv[]) {
     auto bot = FirstBot(args);
     */
 
-    MctsBot bot(rng_seed);
+    MctsBotArgs args;
+    args.max_iterations = max_iterations;
+    MctsBot bot(rng_seed, args);
     bot.init(game);
 
+    // The engine allows 2 seconds per turn.
+    auto turn_limit = std::chrono::milliseconds(2000);
+    TurnTimer timer(turn_limit, std::chrono::milliseconds(200));
+    // Runs with a fixed number of iterations take as long as they need, for the same commands.
+    std::chrono::milliseconds deadline_offset = max_iterations > 0
+        ? std::chrono::hours(24)
+        : turn_limit-std::chrono::milliseconds(50);
+    Watchdog watchdog(game, deadline_offset);
+    // The game exits the process when the engine closes the input, which must not happen while
+    // the bot is pondering.
+    watchdog.set_input_closed_handler([&bot]() { bot.stop_pondering(); });
+
     while (true) {
         game.update_frame();
-        auto now = ms_clock::now();
-        auto turn_end = now+std::chrono::milliseconds(1000);
+        if (!watchdog.start_turn()) {
+            hlt::log::log("watchdog: skipped the turn");
+            continue;
+        }
+        watchdog.set_fallback_commands(get_fallback_commands(game, bot.get_planned_moves()));
+        timer.start_turn(watchdog.get_frame_start());
+        auto turn_end = timer.get_end_time();
         auto commands = bot.run(game, turn_end);
-        if (!game.end_turn(commands)) {
+        timer.end_compute();
+        if (!watchdog.send(commands)) {
+            hlt::log::log("watchdog: sent fallback commands");
+            continue;
+        }
+        if (!std::cout.good()) {
             break;
         }
+        timer.end_emit();
     }
 
     return 0;
@@ -252,6 +252,14 @@ std::vector<hlt::Command> FirstBot::run(const hlt::Game& game, time_point end_ti
     return commands;
 }
 
+std::unordered_map<hlt::EntityId, hlt::Direction> FirstBot::get_planned_moves() const {
+    std::unordered_map<hlt::EntityId, hlt::Direction> moves;
+    for (auto& id_plan : plans) {
+        moves[id_plan.first] = id_plan.second.next_move();
+    }
+    return moves;
+}
+
 void FirstBot::update_previous_positions(const hlt::Game& game) {
     for (auto player : game.players) {
         for (auto pair : player->ships) {
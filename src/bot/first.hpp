@@ -48,6 +48,8 @@ public:
     void init(hlt::Game& game);
 
     std::vector<hlt::Command> run(const hlt::Game& game, time_point end_time);
+    // The next move of each ship's plan.
+    std::unordered_map<hlt::EntityId, hlt::Direction> get_planned_moves() const;
 
 private:
 	hlt::Game advance_game(hlt::Game& game, std::vector<hlt::Command> moves);
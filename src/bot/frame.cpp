@@ -403,3 +403,22 @@ bool Frame::ship_at(hlt::Position pos) const {
     // Seems like it cant be implicitly casted when returning
     return game.game_map->at(pos)->ship ? true : false;
 }
+
+bool Frame::is_inspired(hlt::Position pos, hlt::PlayerId player) const {
+    return hlt::constants::INSPIRATION_ENABLED
+        && get_inspiration().is_inspired(get_index(pos), player);
+}
+
+const InspirationTracker& Frame::get_inspiration() const {
+    if (!inspiration) {
+        auto& game_map = game.game_map;
+        inspiration = std::make_unique<InspirationTracker>(
+            game_map->width, game_map->height, game.players.size());
+        for (auto player : game.players) {
+            for (auto pair : player->ships) {
+                inspiration->add_ship(get_index(pair.second->position), player->id);
+            }
+        }
+    }
+    return *inspiration;
+}
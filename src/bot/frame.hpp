@@ -4,8 +4,11 @@
 #include "hlt/game.hpp"
 #include "hlt/position.hpp"
 #include "hlt/map_cell.hpp"
+#include "bot/inspiration.hpp"
 #include "bot/typedefs.hpp"
 
+#include <memory>
+
 // Must match all_directions
 enum Move {
     STILL_INDEX,
@@ -49,6 +52,9 @@ struct SpawnRes {
 class Frame {
     const hlt::Game& game;
     std::unordered_map<hlt::EntityId, hlt::Direction> last_moves;
+    // Opponent ships within the inspiration radius of each cell. Built on first use, as most
+    // frames never check for inspiration.
+    mutable std::unique_ptr<InspirationTracker> inspiration;
 
 public:
     Frame(const hlt::Game& game);
@@ -84,6 +90,11 @@ public:
 
     bool ship_at(hlt::Position pos) const;
 
+    // Whether a ship of the player would be inspired at the position.
+    bool is_inspired(hlt::Position pos, hlt::PlayerId player) const;
+    // Builds the tracker on the first call, so that must not happen on several threads at once.
+    const InspirationTracker& get_inspiration() const;
+
     // Retrieve the number of cells on the board
     unsigned int get_board_size() const;
 
@@ -45,7 +45,11 @@ hlt::Halite GameClone::get_expectation(Plan& plan, hlt::Ship& ship) const {
     for (size_t i=plan.execution_step; i < plan.path.size(); i++) {
         auto halite = get_halite(pos, plan.path[i].mining_idx);
         if (plan.path[i].direction == hlt::Direction::STILL) {
-            res += ceil_div(halite, hlt::constants::EXTRACT_RATIO);
+            auto mined = ceil_div(halite, hlt::constants::EXTRACT_RATIO);
+            if (is_inspired(pos, ship.owner)) {
+                mined += mined*hlt::constants::INSPIRED_BONUS_MULTIPLIER;
+            }
+            res += mined;
         } else {
             res -= halite/hlt::constants::MOVE_COST_RATIO;
         }
@@ -290,6 +294,10 @@ bool GameClone::is_occupied(hlt::Position pos, int depth) const {
     return turns_until_occupation[idx] != -1 && turns_until_occupation[idx] <= depth;
 }
 
+bool GameClone::is_inspired(hlt::Position pos, hlt::PlayerId player) const {
+    return frame.is_inspired(pos, player);
+}
+
 hlt::Position GameClone::find_close_halite(hlt::Position start) {
     auto visited = std::vector<bool>(frame.get_board_size());
 
@@ -65,6 +65,8 @@ public:
     bool has_own_structure(hlt::Position pos, hlt::PlayerId player) const;
     // Check whether the cell has been occupied after the given number of turns.
     bool is_occupied(hlt::Position pos, int depth) const;
+    // Whether a ship would be inspired at the position, using the ships of the current frame.
+    bool is_inspired(hlt::Position pos, hlt::PlayerId player) const;
 
     // Find the cell with the highest halite/distance.
     hlt::Position find_close_halite(hlt::Position start);
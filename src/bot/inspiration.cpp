@@ -0,0 +1,114 @@
+#include "bot/inspiration.hpp"
+#include "bot/math.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+InspirationTracker::InspirationTracker(int width, int height, int num_players, int num_lanes)
+  : width(width),
+    height(height),
+    board_size(width*height),
+    num_players(num_players),
+    num_lanes(num_lanes),
+    radius(hlt::constants::INSPIRATION_RADIUS),
+    position_x(board_size),
+    position_y(board_size),
+    column_masks((radius+1)*width),
+    num_stored_rows(height+2*radius),
+    original_rows(num_lanes*num_players*num_stored_rows),
+    rows(num_lanes*num_players*num_stored_rows),
+    original_occupied_rows(num_lanes*num_stored_rows),
+    occupied_rows(num_lanes*num_stored_rows)
+{
+    // Each row must fit in a RowBits.
+    assert(width <= 64);
+    for (int position=0; position < board_size; position++) {
+        position_x[position] = position%width;
+        position_y[position] = position/width;
+    }
+    for (int distance=0; distance <= radius; distance++) {
+        for (int x=0; x < width; x++) {
+            RowBits mask = 0;
+            for (int dx=-distance; dx <= distance; dx++) {
+                mask |= RowBits(1) << pos_mod(x+dx, width);
+            }
+            column_masks[distance*width+x] = mask;
+        }
+    }
+}
+
+void InspirationTracker::set_row(RowBits* lane_rows, int y, RowBits value) {
+    int row = y+radius;
+    lane_rows[row] = value;
+    // The copy above the top or below the bottom.
+    if (y < radius) {
+        lane_rows[row+height] = value;
+    } else if (y >= height-radius) {
+        lane_rows[row-height] = value;
+    }
+}
+
+void InspirationTracker::set_bit(RowBits* lane_rows, int y, RowBits bit, bool value) {
+    RowBits row = lane_rows[y+radius];
+    set_row(lane_rows, y, value ? (row | bit) : (row & ~bit));
+}
+
+void InspirationTracker::add_ship(int position, int player) {
+    RowBits bit = RowBits(1) << position_x[position];
+    int y = position_y[position];
+    for (int lane=0; lane < num_lanes; lane++) {
+        set_bit(&original_rows[(lane*num_players+player)*num_stored_rows], y, bit, true);
+        set_bit(&original_occupied_rows[lane*num_stored_rows], y, bit, true);
+        set_bit(&rows[(lane*num_players+player)*num_stored_rows], y, bit, true);
+        set_bit(&occupied_rows[lane*num_stored_rows], y, bit, true);
+    }
+}
+
+void InspirationTracker::reset() {
+    std::copy(original_rows.begin(), original_rows.end(), rows.begin());
+    std::copy(original_occupied_rows.begin(), original_occupied_rows.end(), occupied_rows.begin());
+}
+
+void InspirationTracker::copy_lane(int from_lane, int to_lane) {
+    int lane_size = num_players*num_stored_rows;
+    std::copy_n(&rows[from_lane*lane_size], lane_size, &rows[to_lane*lane_size]);
+    std::copy_n(
+        &occupied_rows[from_lane*num_stored_rows],
+        num_stored_rows,
+        &occupied_rows[to_lane*num_stored_rows]);
+}
+
+void InspirationTracker::set_occupied(int position, int player, int lane, bool is_occupied) {
+    RowBits bit = RowBits(1) << position_x[position];
+    int y = position_y[position];
+    set_bit(&rows[(lane*num_players+player)*num_stored_rows], y, bit, is_occupied);
+
+    // Another player may still have a ship in the cell.
+    int row = y+radius;
+    RowBits occupied = 0;
+    for (int other_player=0; other_player < num_players; other_player++) {
+        occupied |= rows[(lane*num_players+other_player)*num_stored_rows+row];
+    }
+    set_row(&occupied_rows[lane*num_stored_rows], y, occupied);
+}
+
+int InspirationTracker::get_num_opponents(int position, int player, int lane) const {
+    int x = position_x[position];
+    int row = position_y[position]+radius;
+    const RowBits* own_rows = &rows[(lane*num_players+player)*num_stored_rows+row];
+    const RowBits* lane_occupied_rows = &occupied_rows[lane*num_stored_rows+row];
+    const RowBits* masks = &column_masks[x];
+
+    int count = 0;
+    for (int dy=-radius; dy <= radius; dy++) {
+        RowBits mask = masks[(radius-std::abs(dy))*width];
+        RowBits opponents = lane_occupied_rows[dy] & ~own_rows[dy] & mask;
+        // Usually only a few bits are set.
+        while (opponents != 0) {
+            opponents &= opponents-1;
+            count++;
+        }
+    }
+    return count;
+}
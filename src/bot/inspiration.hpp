@@ -0,0 +1,71 @@
+#pragma once
+
+#include "hlt/constants.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// The cells of a row as bits. Maps are at most 64 cells wide.
+using RowBits = uint64_t;
+
+// Tracks which cells are occupied by each player, to count the opponents within the inspiration
+// radius of a cell.
+//
+// Each row of the map is stored as bits, so moving a ship only changes two bits, and counting the
+// opponents takes one masked row for each row within the radius.
+//
+// Several independent copies, called lanes, can be stored as in MctsSimulation. reset restores
+// all lanes to the ships that were added.
+class InspirationTracker {
+    int width;
+    int height;
+    int board_size;
+    int num_players;
+    int num_lanes;
+    int radius;
+
+    // Coordinates of each position.
+    std::vector<int> position_x;
+    std::vector<int> position_y;
+    // The columns within a distance of each column, indexed by distance*width+x.
+    std::vector<RowBits> column_masks;
+
+    // Rows stored for each lane and player. The rows within the radius of the top and bottom are
+    // stored twice, so that the rows around a position never wrap around.
+    int num_stored_rows;
+
+    // Cells occupied by each player, indexed by (lane*num_players+player)*num_stored_rows+row,
+    // where the row of y is y+radius.
+    std::vector<RowBits> original_rows;
+    std::vector<RowBits> rows;
+    // Cells occupied by any player, indexed by lane*num_stored_rows+row.
+    std::vector<RowBits> original_occupied_rows;
+    std::vector<RowBits> occupied_rows;
+
+public:
+    InspirationTracker(int width, int height, int num_players, int num_lanes=1);
+
+    // Add a ship to all lanes, including the state restored by reset.
+    void add_ship(int position, int player);
+    // Restore all lanes to the added ships.
+    void reset();
+
+    // Copy all ships of one lane to another.
+    void copy_lane(int from_lane, int to_lane);
+
+    // Set whether a player has a ship at a position in a lane.
+    void set_occupied(int position, int player, int lane, bool is_occupied);
+
+    // The number of cells within the radius that hold a ship of another player.
+    int get_num_opponents(int position, int player, int lane=0) const;
+
+    bool is_inspired(int position, int player, int lane=0) const {
+        return get_num_opponents(position, player, lane) >= hlt::constants::INSPIRATION_SHIP_COUNT;
+    }
+
+private:
+    // Set a row in all of its stored copies.
+    void set_row(RowBits* lane_rows, int y, RowBits value);
+    // Set a bit of a row in all of its stored copies.
+    void set_bit(RowBits* lane_rows, int y, RowBits bit, bool value);
+};
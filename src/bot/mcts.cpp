@@ -1,18 +1,20 @@
 #include "bot/math.hpp"
 #include "bot/mcts.hpp"
+#include "bot/mcts_simulation.hpp"
+#include "bot/mcts_tree.hpp"
 #include "bot/frame.hpp"
+#include "hlt/log.hpp"
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <numeric>
 #include <random>
+#include <string>
+#include <thread>
 
 //#define DEBUG
 
-// Larger values will increase exploration, smaller will increase exploitation.
-const float EXPLORATION_CONSTANT = std::sqrt(2.0);
-
-// The maximum depth that moves will be generated for
-const int MAX_DEPTH = 50;
-
 // Number of simulations used to generate a score to beat when we don't have one from the previous
 // turn
 const int NUM_INIT_SIMULATIONS = 10;
@@ -21,714 +23,325 @@ const int NUM_INIT_SIMULATIONS = 10;
 // If set to false, simulations will be reused to update all trees.
 const bool ISOLATE_SHIPS = false;
 
-// Inspiration can be costly
-const bool INSPIRATION_ENABLED = false;
-
-// A container for moves that allows faster access than a vec of vecs
-struct ShipMoves {
-    int num_ships;
-    // Set to -1 if all moves are counted. Otherwise only the specified ship has any moves.
-    int isolated_ship;
-    std::vector<int> num_moves;
-    std::vector<int> moves;
-
-    ShipMoves(int num_ships)
-      : num_ships(num_ships),
-        isolated_ship(-1),
-        num_moves(num_ships),
-        moves(num_ships*(MAX_DEPTH+1))
-    {
-    }
-
-    bool is_active(int ship_idx) const {
-        return isolated_ship == -1 || isolated_ship == ship_idx;
-    }
-
-    void isolate(int ship_idx) {
-        isolated_ship = ship_idx;
-    }
-
-    int get_path_size(int ship_idx) const {
-        return is_active(ship_idx) ? num_moves[ship_idx] : 0;
-    }
-
-    bool is_move_specified(int ship_idx, int depth) const {
-        return is_active(ship_idx) ? (depth < num_moves[ship_idx]) : false;
-    }
-
-    int get_move(int ship_idx, int depth) const {
-        return moves[depth*num_ships+ship_idx];
-    }
-
-    void push_bounded(int ship_idx, int move, int bound) {
-        int depth = num_moves[ship_idx];
-        if (depth < bound) {
-            moves[depth*num_ships+ship_idx] = move;
-            num_moves[ship_idx]++;
-        }
-    }
-
-    void push(int ship_idx, int move) {
-        push_bounded(ship_idx, move, MAX_DEPTH);
-    }
-
-    void push_temp(int ship_idx, int move) {
-        push_bounded(ship_idx, move, MAX_DEPTH+1);
-    }
-
-    void pop(int ship_idx) {
-        num_moves[ship_idx]--;
-    }
-
-    void clear(int ship_idx) {
-        num_moves[ship_idx] = 0;
-    }
-
-    friend std::ostream& operator<<(std::ostream& os, const ShipMoves& moves);
-};
-
-std::ostream& operator<<(std::ostream& os, const ShipMoves& moves) {
-    os << "{";
-    for (int ship_idx=0; ship_idx < moves.num_ships; ship_idx++) {
-        os << (ship_idx == 0 ? " " : ", ") << "[";
-        for (int depth=0; moves.is_move_specified(ship_idx, depth); depth++) {
-            os << (depth == 0 ? " " : ", ");
-            os << moves.get_move(ship_idx, depth);
-        }
-        os << " ]";
-    }
-    os << " }";
-    return os;
-}
-
-struct MctsTreeNode {
-    int visits;
-    float total_reward;
-    std::vector<std::unique_ptr<MctsTreeNode>> children;
-
-    MctsTreeNode()
-      : visits(0),
-        total_reward(0)
-    {
-    }
-
-    bool is_expanded() const {
-        return !children.empty();
-    }
-
-    hlt::Direction best_move() {
-        int best_child = 0;
-        int best_visits = 0;
-#ifdef DEBUG
-        float best_total_reward = 0;
-#endif
-        for (unsigned int child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
-            if (children[child_idx]->visits > best_visits) {
-                best_visits = children[child_idx]->visits;
-                best_child = child_idx;
-#ifdef DEBUG
-                best_total_reward = children[child_idx]->total_reward;
-#endif
-            }
-        }
-#ifdef DEBUG
-        std::cerr << "best_move: " << best_child << ": " << best_total_reward << "/" << best_visits << std::endl;
-#endif
-        return ALL_DIRECTIONS[best_child];
-    }
-
-    int get_best_child() {
-        float best_score = -1.0;
-        int best_child = 0;
-        for (unsigned int child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
-            auto& child = *children[child_idx];
-            float exploit = ((float)child.total_reward)/child.visits;
-            // Decreases when child is visited
-            float explore = std::sqrt(std::log(visits)/child.visits);
-            float score = exploit+EXPLORATION_CONSTANT*explore;
-            // TODO why random choice when about equal?
-            if (score > best_score) {
-                best_child = child_idx;
-                best_score = score;
-            }
-        }
-        return best_child;
-    }
-
-    // function TREEPOLICY(v)
-    //     while v is nonterminal do
-    //         if v not fully expanded then
-    //             return EXPAND(v)
-    //         else
-    //             v ← BESTCHILD(v, Cp)
-    //     return v
-    //
-    void tree_policy(ShipMoves& moves, int ship_idx) {
-        if (is_expanded()) {
-            int best_child = get_best_child();
-            moves.push(ship_idx, best_child);
-            if (!moves.is_move_specified(ship_idx, MAX_DEPTH-1)) {
-                children[best_child]->tree_policy(moves, ship_idx);
-            }
-        } else {
-            // Expand
-            for (size_t move = 0; move < ALL_DIRECTIONS.size(); move++) {
-                children.push_back(std::make_unique<MctsTreeNode>());
-            }
-        }
-    }
-
-    void update_rec(const ShipMoves& moves, int depth, int ship_idx, float reward) {
-        visits++;
-        total_reward += reward;
-        if (moves.is_move_specified(ship_idx, depth)) {
-            children[moves.get_move(ship_idx, depth)]->update_rec(moves, depth+1, ship_idx, reward);
-        }
-    }
-
-    void update(const ShipMoves& moves, int ship_idx, float reward) {
-        update_rec(moves, 0, ship_idx, reward);
-    }
-
-    friend std::ostream& operator<<(std::ostream& os, const MctsTreeNode& node);
-};
-
-std::ostream& operator<<(std::ostream& os, const MctsTreeNode& node) {
-    os << "{ " << node.total_reward << "/" << node.visits;
-    if (node.is_expanded()) {
-        os << " [";
-        for (auto& child : node.children) {
-            os << " " << *child;
-        }
-        os << " ]";
-    }
-    os << " }";
-    return os;
-}
-
-struct MctsTree {
-    // Scores to compare against. A score > this value is counted as a win, while less than this is
-    // a draw.
-    // Usually the previous average scores are compared against.
-    float comparison_score;
-    // Sum of current scores to compute the average.
-    float current_score_sum;
-
-    MctsTreeNode root;
-
-    MctsTree(float comparison_score)
-      : comparison_score(comparison_score),
-        current_score_sum(0)
-    {
-    }
-
-    // Get the best move found by the mcts
-    hlt::Direction best_move() {
-        return root.best_move();
-    }
-
-    // Sets the path in the moves struct instead of returning a newly allocated path.
-    void tree_policy(ShipMoves& moves, int ship_idx) {
-        moves.clear(ship_idx);
-        root.tree_policy(moves, ship_idx);
-    }
-
-    // Update the tree using a score that does not need to be normalized.
-    void update(const ShipMoves& moves, int ship_idx, float score) {
-        current_score_sum += score;
-        float reward = 0.5;
-        if (score > comparison_score) { reward = 1.0; }
-        if (score < comparison_score) { reward = 0.0; }
-        root.update(moves, ship_idx, reward);
-    }
-
-    // Retrieve the average score that the ship has gained across all simulations.
-    float get_average_score() {
-        return current_score_sum/root.visits;
-    }
-};
-
-struct SimulatedShip {
-    int position;
-    hlt::Halite halite;
-    int turns_underway;
-    // Set to -1 if the dropoff has not been reached yet.
-    float halite_per_turn;
-    bool destroyed;
-    hlt::PlayerId player;
-
-    SimulatedShip(int position, hlt::Halite halite, int turns_underway, hlt::PlayerId player)
-      : position(position),
-        halite(halite),
-        turns_underway(turns_underway),
-        halite_per_turn(-1),
-        destroyed(false),
-        player(player)
-    {
-    }
-};
-
-struct RandomPolicy {
-    int get_move(std::mt19937& generator) {
-        // distribution is inclusive
-        std::uniform_int_distribution<int> distribution(1, ALL_DIRECTIONS.size()-1);
-        return distribution(generator);
-    }
-};
-
-struct GravityPolicy {
-    GravityGrid& mining_grid;
-    GravityGrid& return_grid;
-
-    GravityPolicy(GravityGrid& mining_grid, GravityGrid& return_grid)
-      : mining_grid(mining_grid),
-        return_grid(return_grid)
-    {
-    }
-
-    float get_move_weight(int move, int position, hlt::Halite current_halite) {
-        float pull_fraction =
-            ((float)hlt::constants::MAX_HALITE-current_halite)/hlt::constants::MAX_HALITE;
-        float return_fraction = 1.0-pull_fraction;
-        float res = 0;
-        res += pull_fraction*mining_grid.get_pull(position, move);
-        res += return_fraction*return_grid.get_pull(position, move);
-        return res;
-    }
-};
-
-// Wrapper around other policies that allows removing moves
-// This is useful for avoiding collisions in rollouts.
-struct MovePolicy {
-    GravityPolicy policy;
-
-    MovePolicy(GravityPolicy policy)
-      : policy(policy)
+// Visits added along a path while its simulations are running, when several threads search the
+// same tree. Each path is simulated once for every move.
+const int VIRTUAL_LOSS = 5;
+
+// Number of batches between the checks for converged trees, and before the budget of sequential
+// halving is estimated.
+const int CONVERGENCE_CHECK_INTERVAL = 16;
+
+// Share of each pool that the subtrees reused from the last turn may take, split evenly between
+// the trees. The rest is left for the search of the turn, and for the roots of new trees.
+const float MAX_REUSED_SHARE = 0.5;
+
+// A single search thread. Owns its simulation, whose lanes draw from streams split from the given
+// rng. The trees are either owned by this worker alone, or shared between all workers in which
+// case virtual loss is used to spread them out.
+struct MctsWorker {
+    MctsSimulation simulation;
+    ShipMoves simulation_moves;
+    std::vector<MctsTree>& trees;
+    int virtual_loss;
+    // Number of turns simulated by each rollout.
+    int max_depth;
+    // If not 0, rollouts end this many turns after the longest path of the batch.
+    int rollout_tail;
+    // Buffer for the simulation results.
+    std::vector<float> results;
+
+    // Sum of the scores of the simulations of this worker, for each ship.
+    std::vector<float> score_sums;
+    std::vector<int> num_scores;
+    // Number of simulated rollouts, each lane counted separately.
+    int num_rollouts;
+    // Number of turns simulated by all batches, to measure the time per turn.
+    long long num_batch_turns;
+    // Number of turns simulated for a ship in a lane by all batches.
+    long long num_ship_steps;
+    // Number of batches, and the time spent simulating them.
+    int num_batches;
+    double simulation_seconds;
+
+    // Whether trees stop being searched once their most visited root move can not change anymore.
+    bool freeze_converged;
+    // Whether the root moves are selected by sequential halving.
+    bool sequential_halving;
+    // Trees that are no longer searched. Their ships keep the most visited root move.
+    std::vector<bool> is_frozen;
+    int num_frozen;
+    // Number of times a frozen tree was skipped by a batch.
+    long long num_skipped_paths;
+
+    MctsWorker(
+        Rng generator,
+        const Frame& frame,
+        const std::vector<SimulatedShip>& ships,
+        const PolicyTable& policy_table,
+        bool inspiration_enabled,
+        bool common_random_numbers,
+        bool leaf_evaluator_enabled,
+        std::vector<MctsTree>& trees,
+        int virtual_loss,
+        int max_depth,
+        int rollout_tail,
+        bool freeze_converged,
+        bool sequential_halving
+    )
+      : simulation(
+            generator,
+            frame,
+            ships,
+            policy_table,
+            inspiration_enabled,
+            common_random_numbers,
+            leaf_evaluator_enabled),
+        simulation_moves(ships.size(), trees.size()),
+        trees(trees),
+        virtual_loss(virtual_loss),
+        max_depth(max_depth),
+        rollout_tail(rollout_tail),
+        score_sums(ships.size()),
+        num_scores(ships.size()),
+        num_rollouts(0),
+        num_batch_turns(0),
+        num_ship_steps(0),
+        num_batches(0),
+        simulation_seconds(0),
+        freeze_converged(freeze_converged),
+        sequential_halving(sequential_halving),
+        is_frozen(trees.size()),
+        num_frozen(0),
+        num_skipped_paths(0)
     {
     }
 
-    int get_move(std::mt19937& rng, int position, hlt::Halite current_halite, bool allowed_moves[4]) {
-        float weights[4];
-        for (size_t move=1; move < ALL_DIRECTIONS.size(); move++) {
-            if (allowed_moves[move-1]) {
-                weights[move-1] = policy.get_move_weight(move, position, current_halite);
-            } else {
-                weights[move-1] = 0;
-            }
+    // Update the tree of a ship with its score in a lane of the last batch.
+    void update(int ship_idx, int lane) {
+        // The results hold every simulated ship, of which the searched ships are a prefix.
+        assert(results.size() == (size_t)NUM_LANES*simulation_moves.num_ships);
+        assert(ship_idx < simulation_moves.num_searched_ships);
+        float score = results[lane*simulation_moves.num_ships+ship_idx];
+        if (!is_frozen[ship_idx]) {
+            trees[ship_idx].update(simulation_moves, ship_idx, score);
         }
-
-        float sum_weights = 0;
-        for (auto w : weights) { sum_weights += w; }
-        if (sum_weights == 0) { return 0; }
-
-        float rand = std::uniform_real_distribution<float>()(rng);
-        float move_treshold = 0;
-        for (size_t move = 1; move < ALL_DIRECTIONS.size(); move++) {
-            move_treshold += weights[move-1]/sum_weights;
-            if (rand < move_treshold) { return move; }
-        }
-        return 0;
-    }
-};
-
-struct MiningPolicy {
-    int map_size;
-
-    MiningPolicy(int map_size)
-      : map_size(map_size)
-    {
+        score_sums[ship_idx] += score;
+        num_scores[ship_idx]++;
     }
 
-    bool should_mine(std::mt19937& generator, hlt::Halite halite_at_position, hlt::Halite total_halite) {
-        float average_halite = ((float)total_halite)/map_size;
-        float treshold = halite_at_position/(2*average_halite);
-        float rand = std::uniform_real_distribution<float>()(generator);
-        return rand < treshold;
-    }
-};
-
-struct MctsSimulation {
-    const Frame& frame;
-    int width;
-    int height;
-
-    std::vector<SimulatedShip> original_ships;
-    std::vector<hlt::Halite> original_halite;
-    hlt::Halite total_halite;
-
-    std::mt19937& generator;
-    MiningPolicy mining_policy;
-    std::vector<MovePolicy> move_policies;
-
-    // The distances to each dropoff from each position for each player
-    std::vector<std::vector<int>> distance_to_dropoff;
-
-    // Precalculated values
-    std::vector<int> orig_num_ships_in_cell;
-    std::vector<std::vector<int>> orig_num_own_ships_in_cell;
-
-    // For each position, how many ships are within inspiration range
-    std::vector<int> orig_num_inspiring_ships;
-    // For each player, how many own ships within range to subtract.
-    std::vector<std::vector<int>> orig_num_own_inspiring_ships;
-
-    MctsSimulation(
-        std::mt19937& generator,
-        const Frame& frame,
-        std::vector<SimulatedShip> ships,
-        std::vector<MovePolicy> move_policies
-    )
-      : frame(frame),
-        width(frame.get_game().game_map->width),
-        height(frame.get_game().game_map->height),
-        original_ships(ships),
-        original_halite(frame.get_board_size()),
-        total_halite(0),
-        generator(generator),
-        mining_policy(width*height),
-        move_policies(move_policies),
-        orig_num_ships_in_cell(width*height),
-        orig_num_inspiring_ships(width*height)
-    {
-        auto& game_map = frame.get_game().game_map;
-        // Initialize halite
-        for (int y=0; y < height; y++) {
-            for (int x=0; x < width; x++) {
-                hlt::Position pos(x, y);
-                auto idx = frame.get_index(pos);
-                original_halite[idx] = game_map->at(pos)->halite;
-                total_halite += original_halite[idx];
-            }
-        }
-
-        // Initialize distance_to_dropoff
-        for (auto player : frame.get_game().players) {
-            std::vector<int> distances(width*height);
-            for (int y=0; y < height; y++) {
-                for (int x=0; x < width; x++) {
-                    int shipyard_dist = game_map->calculate_distance(
-                        hlt::Position(x, y),
-                        player->shipyard->position
-                    );
-                    distances[y*width+x] = shipyard_dist;
+    // Freeze the trees where the lead of the most visited root move is larger than the visits
+    // the tree can still get. new_visits_per_visit is the expected number of further visits for
+    // each visit since start_visits.
+    void freeze_converged_trees(const std::vector<int>& start_visits, float new_visits_per_visit) {
+        for (size_t ship_idx=0; ship_idx < trees.size(); ship_idx++) {
+            if (is_frozen[ship_idx]) { continue; }
+            std::array<int, 5> root_visits = {};
+            trees[ship_idx].add_root_visits(root_visits);
+            int best_move = 0;
+            int best_visits = 0;
+            int second_visits = 0;
+            for (size_t move=0; move < ALL_DIRECTIONS.size(); move++) {
+                if (root_visits[move] > best_visits) {
+                    second_visits = best_visits;
+                    best_visits = root_visits[move];
+                    best_move = move;
+                } else {
+                    second_visits = std::max(second_visits, root_visits[move]);
                 }
             }
-            distance_to_dropoff.push_back(distances);
-        }
-
-        // Initialize num_ships_in_cell
-        for (auto player : frame.get_game().players) {
-            std::vector<int> num_ships(width*height);
-            for (auto& ship : ships) {
-                if (ship.player == player->id) {
-                    num_ships[ship.position] = 1;
-                    orig_num_ships_in_cell[ship.position] = 1;
-                }
+            int new_visits = trees[ship_idx].get_root_visits()-start_visits[ship_idx];
+            if (best_visits-second_visits > new_visits*new_visits_per_visit) {
+                is_frozen[ship_idx] = true;
+                num_frozen++;
+                simulation_moves.freeze(ship_idx, best_move);
             }
-            orig_num_own_ships_in_cell.push_back(num_ships);
         }
-
-        // Initialize inspiration
-        for (size_t i=0; i < frame.get_game().players.size(); i++) {
-            orig_num_own_inspiring_ships.push_back(std::vector<int>(width*height));
-        }
-        for (auto& ship : ships) {
-            add_inspiration(orig_num_inspiring_ships, ship.position, 1);
-            add_inspiration(orig_num_own_inspiring_ships[ship.player], ship.position, 1);
-        }
-    }
-
-    int move_position(int position, int dx, int dy) {
-        int x = position%width;
-        int y = position/width;
-        x = pos_mod(x+dx, width);
-        y = pos_mod(y+dy, height);
-        return frame.get_index(hlt::Position(x, y));
     }
 
-    int reverse_move(int move) {
-        switch (move) {
-            case STILL_INDEX: return STILL_INDEX;
-            case NORTH_INDEX: return SOUTH_INDEX;
-            case SOUTH_INDEX: return NORTH_INDEX;
-            case EAST_INDEX: return WEST_INDEX;
-            case WEST_INDEX: return EAST_INDEX;
-            default: return STILL_INDEX;
+    // Keep searching the trees of the turn after its moves have been chosen. Nothing is frozen,
+    // and the root moves of own ships should be fixed to the chosen moves.
+    void start_pondering() {
+        freeze_converged = false;
+        sequential_halving = false;
+        for (size_t ship_idx=0; ship_idx < trees.size(); ship_idx++) {
+            simulation_moves.unfreeze(ship_idx);
+            is_frozen[ship_idx] = false;
         }
+        num_frozen = 0;
     }
 
-    int move_position(int position, int move) {
-        switch (move) {
-            case STILL_INDEX: return position;
-            case NORTH_INDEX: return pos_mod(position-width, width*height);
-            case SOUTH_INDEX: return (position+width)%(width*height);
-            case EAST_INDEX:
-                if (position%width == width-1) {
-                    return position - (width-1);
-                } else {
-                    return position + 1;
-                }
-            case WEST_INDEX:
-                if (position%width == 0) {
-                    return position + (width-1);
-                } else {
-                    return position - 1;
-                }
-            default: return position;
+    // Run simulations and update trees until end_time, until max_iterations batches have been
+    // simulated, or until stop is set.
+    void search(
+        time_point end_time,
+        int max_iterations=INT32_MAX,
+        const std::atomic<bool>* stop=nullptr
+    ) {
+        auto search_start = ms_clock::now();
+        std::vector<int> start_visits;
+        for (auto& tree : trees) {
+            start_visits.push_back(tree.get_root_visits());
+            if (sequential_halving) { tree.start_halving(); }
         }
-    }
-
-    int get_distance_to_dropoff(int pos, int player) {
-        return distance_to_dropoff[player][pos];
-    }
-
-    std::vector<float> run(const ShipMoves& moves, int max_depth) {
-        std::vector<SimulatedShip> ships(original_ships);
-        // Moves taken by each ship. Stored so that all ships can be updated at the end.
-        std::vector<int> taken_moves(ships.size());
-
-        // length = board_size
-        std::vector<std::vector<int>> num_own_ships_in_cell(orig_num_own_ships_in_cell);
-        std::vector<int> num_ships_in_cell(orig_num_ships_in_cell);
-
-        // Number of moves used from the given moves. Usually will be equal to depth,
-        // but might not be in the case that a ship has been delayed due to collision avoidance.
-        std::vector<int> planned_moves_taken(ships.size());
-
-        std::vector<hlt::Halite> halite(original_halite);
-        // For each position, how many ships are within inspiration range
-        std::vector<int> num_inspiring_ships(orig_num_inspiring_ships);
-        // For each player, how many own ships within range to subtract.
-        std::vector<std::vector<int>> num_own_inspiring_ships(orig_num_own_inspiring_ships);
 
+        int num_iterations = 0;
+        for (auto now = search_start; now < end_time; now = ms_clock::now()) {
 #ifdef DEBUG
-        // All taken moves, for debug purposes
-        std::vector<std::vector<int>> all_taken_moves(ships.size());
-        std::vector<std::vector<int>> all_current_halite(ships.size());
-        std::vector<std::vector<float>> all_current_res(ships.size());
+            if (num_iterations == 10) break;
 #endif
-
-        int turns_left = hlt::constants::MAX_TURNS-frame.get_game().turn_number;
-        max_depth = std::min(turns_left, max_depth);
-        // Simulation
-        for (int depth=0; depth < max_depth; depth++) {
-            // Update ships and halite
-            for (size_t ship_idx=0; ship_idx < ships.size(); ship_idx++) {
-                auto& ship = ships[ship_idx];
-                if (ship.destroyed) { continue; }
-
-                auto num_non_inspiring = num_own_inspiring_ships[ship.player][ship.position];
-                auto inspiration_count = num_inspiring_ships[ship.position]-num_non_inspiring;
-                bool is_inspired = (inspiration_count >= hlt::constants::INSPIRATION_SHIP_COUNT);
-
-                int move;
-                if (moves.is_move_specified(ship_idx, planned_moves_taken[ship_idx])) {
-                    move = moves.get_move(ship_idx, planned_moves_taken[ship_idx]);
-                    int neighbor = move_position(ship.position, move);
-                    // Only avoid own ships in searched nodes. Opponents might not be as nice as we are.
-                    if (move != STILL_INDEX && num_own_ships_in_cell[ship.player][neighbor] != 0) {
-                        move = STILL_INDEX;
-                    } else {
-                        planned_moves_taken[ship_idx]++;
-                    }
-                } else {
-                    bool should_mine =
-                        mining_policy.should_mine(generator, halite[ship.position], total_halite);
-                    if (should_mine) {
-                        move = STILL_INDEX;
-                    } else {
-                        auto& policy = move_policies[ship.player];
-                        // avoid collisions
-                        bool possible_moves[4];
-                        // Avoid all collisions when using default policy
-                        // Collisions can be avoided anyway, so should not fear going closer
-                        for (size_t move=1; move < ALL_DIRECTIONS.size(); move++) {
-                            int neighbor = move_position(ship.position, move);
-                            possible_moves[move-1] = (num_ships_in_cell[neighbor] == 0);
-                        }
-                        move = policy.get_move(generator, ship.position, ship.halite, possible_moves);
-                    }
-                }
-                // Not possible to move
-                if (halite[ship.position]/hlt::constants::MOVE_COST_RATIO > ship.halite) {
-                    move = STILL_INDEX;
-                }
-                taken_moves[ship_idx] = move;
-                if (ALL_DIRECTIONS[move] == hlt::Direction::STILL) {
-                    // Mining
-                    auto max_mined = ceil_div(halite[ship.position], hlt::constants::EXTRACT_RATIO);
-                    if (is_inspired) { max_mined *= hlt::constants::INSPIRED_BONUS_MULTIPLIER; }
-
-                    auto old_halite = ship.halite;
-                    ship.halite += max_mined;
-                    ship.halite =
-                        std::max(0, std::min(hlt::constants::MAX_HALITE, ship.halite));
-
-                    auto removed_halite = ship.halite-old_halite;
-                    if (is_inspired) { removed_halite /= hlt::constants::INSPIRED_BONUS_MULTIPLIER; }
-                    halite[ship.position] -= removed_halite;
-                } else {
-                    // Moving
-                    ship.halite -= halite[ship.position]/hlt::constants::MOVE_COST_RATIO;
-                    num_ships_in_cell[ship.position]--;
-                    num_own_ships_in_cell[ship.player][ship.position]--;
-                    ship.position = move_position(ship.position, move);
-                    num_ships_in_cell[ship.position]++;
-                    num_own_ships_in_cell[ship.player][ship.position]++;
-                }
-                ship.turns_underway++;
-                if (get_distance_to_dropoff(ship.position, ship.player) == 0
-                    && ship.halite_per_turn < 0
-                ) {
-                    ship.halite_per_turn = ((float)ship.halite)/ship.turns_underway;
+            if (num_iterations == max_iterations) { break; }
+            if (stop != nullptr && stop->load(std::memory_order_relaxed)) { break; }
+            if ((freeze_converged || sequential_halving)
+                    && num_iterations > 0
+                    && num_iterations%CONVERGENCE_CHECK_INTERVAL == 0) {
+                float remaining = ((float)max_iterations-num_iterations)/num_iterations;
+                if (end_time != time_point::max()) {
+                    remaining = std::min(remaining,
+                        std::chrono::duration<float>(end_time-now).count()
+                        /std::chrono::duration<float>(now-search_start).count());
                 }
-
-#ifdef DEBUG
-                all_taken_moves[ship_idx].push_back(move);
-                all_current_halite[ship_idx].push_back(ship.halite);
-                all_current_res[ship_idx].push_back(ship.halite_per_turn);
-#endif
-            }
-
-            // Destroy ships
-            for (auto& ship : ships) {
-                if (num_ships_in_cell[ship.position] > 1) {
-                    ship.destroyed = true;
-                    ship.halite = 0;
-                    num_own_ships_in_cell[ship.player][ship.position] = 0;
+                if (sequential_halving && num_iterations == CONVERGENCE_CHECK_INTERVAL) {
+                    for (size_t ship_idx=0; ship_idx < trees.size(); ship_idx++) {
+                        int new_visits = trees[ship_idx].get_root_visits()-start_visits[ship_idx];
+                        trees[ship_idx].set_halving_budget(new_visits*(1+remaining));
+                    }
                 }
-            }
-            for (auto& ship : ships) {
-                if (num_ships_in_cell[ship.position] > 1) {
-                    num_ships_in_cell[ship.position] = 0;
+                if (freeze_converged) {
+                    freeze_converged_trees(start_visits, remaining);
+                    if (num_frozen == (int)trees.size()) { break; }
                 }
             }
-
-            // Update inspiration
-            for (size_t ship_idx = 0; ship_idx < ships.size(); ship_idx++) {
-                auto& ship = ships[ship_idx];
-                update_inspiration(num_inspiring_ships, ship.position, taken_moves[ship_idx]);
-                update_inspiration(
-                    num_own_inspiring_ships[ship.player], ship.position, taken_moves[ship_idx]);
+            num_iterations++;
+            num_batches++;
+            num_skipped_paths += num_frozen;
+
+            for (size_t ship_idx=0; ship_idx < trees.size(); ship_idx++) {
+                if (is_frozen[ship_idx]) { continue; }
+                // Sets the move in the ShipMoves buffer
+                trees[ship_idx].tree_policy(simulation_moves, ship_idx, max_depth, virtual_loss);
             }
-        }
+            //std::cerr << simulation_moves << std::endl;
 
-        std::vector<float> res(ships.size());
-        for (size_t ship_idx=0; ship_idx < ships.size(); ship_idx++) {
-            auto& ship = ships[ship_idx];
-            if (ship.destroyed) {
-                res[ship_idx] = 0.0;
-            } else if (ship.halite_per_turn >= 0) {
-                res[ship_idx] = ship.halite_per_turn;
-            } else {
-                // An estimate of turns needed to reach a dropoff, assuming each cell has
-                // an equal, non-zero amount of halite
-                float turns_spent_mining =
-                    ((float)hlt::constants::EXTRACT_RATIO)/hlt::constants::MOVE_COST_RATIO;
-                float remaining_turns =
-                    get_distance_to_dropoff(ship.position, ship.player)*(1.0+turns_spent_mining);
-                if (max_depth+remaining_turns <= turns_left) {
-                    res[ship_idx] = ((float)ship.halite)/(ship.turns_underway+remaining_turns);
-                } else {
-                    // Not making it before the end of the game.
-                    res[ship_idx] = 0.0;
+            int batch_depth = max_depth;
+            if (rollout_tail != 0) {
+                int longest_path = 0;
+                for (size_t ship_idx=0; ship_idx < trees.size(); ship_idx++) {
+                    longest_path = std::max(longest_path, simulation_moves.get_path_size(ship_idx));
                 }
+                // The move of the lane is taken after the path.
+                batch_depth = std::min(max_depth, longest_path+1+rollout_tail);
             }
-        }
-
-#ifdef DEBUG
-        std::cerr << "simulation" << std::endl;
-        std::cerr << moves << std::endl;
-        for (size_t ship_idx=0; ship_idx < ships.size(); ship_idx++) {
-            for (int move_idx=0; move_idx < all_taken_moves[ship_idx].size(); move_idx++) {
-                std::cerr << all_taken_moves[ship_idx][move_idx] << ":"
-                    << all_current_halite[ship_idx][move_idx] << "="
-                    << all_current_res[ship_idx][move_idx] << " ";
-            }
-            std::cerr << "= " << res[ship_idx] << std::endl;
-        }
-#endif
 
-        return res;
-    }
-
-    const std::array<std::pair<int, int>, 7> INSPIRATION_FRONTIER_LEFT = {{
-        {0, -3}, {-1, -2}, {-2, -1}, {-3, 0}, {-2, 1}, {-1, 2}, {0, 3}
-    }};
-    const std::array<std::pair<int, int>, 7> INSPIRATION_FRONTIER_RIGHT = {{
-        {0, -3}, {1, -2}, {2, -1}, {3, 0}, {2, 1}, {1, 2}, {0, 3}
-    }};
-    const std::array<std::pair<int, int>, 7> INSPIRATION_FRONTIER_UP = {{
-        {-3, 0}, {-2, -1}, {-1, -2}, {0, -3}, {1, -2}, {2, -1}, {3, 0}
-    }};
-    const std::array<std::pair<int, int>, 7> INSPIRATION_FRONTIER_DOWN = {{
-        {-3, 0}, {-2, 1}, {-1, 2}, {0, 3}, {1, 2}, {2, 1}, {3, 0}
-    }};
-
-    // Update inspiration by moving a single ship. `position` is the new position of the ship.
-    void update_inspiration(std::vector<int>& inspiration_grid, int position, int last_move) {
-        if (INSPIRATION_ENABLED) {
-            int prev_pos = move_position(position, reverse_move(last_move));
-            switch (last_move) {
-                case STILL_INDEX: return;
-                case NORTH_INDEX:
-                    for (auto delta : INSPIRATION_FRONTIER_DOWN) {
-                        inspiration_grid[move_position(prev_pos, delta.first, delta.second)]--;
-                    }
-                    for (auto delta : INSPIRATION_FRONTIER_UP) {
-                        inspiration_grid[move_position(position, delta.first, delta.second)]++;
-                    }
-                    break;
-                case SOUTH_INDEX:
-                    for (auto delta : INSPIRATION_FRONTIER_UP) {
-                        inspiration_grid[move_position(prev_pos, delta.first, delta.second)]--;
-                    }
-                    for (auto delta : INSPIRATION_FRONTIER_DOWN) {
-                        inspiration_grid[move_position(position, delta.first, delta.second)]++;
-                    }
-                    break;
-                case EAST_INDEX:
-                    for (auto delta : INSPIRATION_FRONTIER_LEFT) {
-                        inspiration_grid[move_position(prev_pos, delta.first, delta.second)]--;
-                    }
-                    for (auto delta : INSPIRATION_FRONTIER_RIGHT) {
-                        inspiration_grid[move_position(position, delta.first, delta.second)]++;
-                    }
-                    break;
-                case WEST_INDEX:
-                    for (auto delta : INSPIRATION_FRONTIER_RIGHT) {
-                        inspiration_grid[move_position(prev_pos, delta.first, delta.second)]--;
+            // All moves after the paths are simulated together, one in each lane.
+            if (ISOLATE_SHIPS) {
+                for (size_t ship_idx=0; ship_idx < trees.size(); ship_idx++) {
+                    // Frozen ships leave their time to the others.
+                    if (is_frozen[ship_idx]) { continue; }
+                    simulation_moves.isolate(ship_idx);
+                    auto simulation_start = ms_clock::now();
+                    num_batch_turns += simulation.run_batch(simulation_moves, batch_depth, results);
+                    num_ship_steps += simulation.get_num_ship_steps();
+                    simulation_seconds +=
+                        std::chrono::duration<double>(ms_clock::now()-simulation_start).count();
+                    num_rollouts += NUM_LANES;
+                    for (int possible_move = 0; possible_move < NUM_LANES; possible_move++) {
+                        simulation_moves.push_temp(ship_idx, possible_move);
+                        update(ship_idx, possible_move);
+                        simulation_moves.pop(ship_idx);
                     }
-                    for (auto delta : INSPIRATION_FRONTIER_LEFT) {
-                        inspiration_grid[move_position(position, delta.first, delta.second)]++;
+                }
+            } else {
+                auto simulation_start = ms_clock::now();
+                num_batch_turns += simulation.run_batch(simulation_moves, batch_depth, results);
+                num_ship_steps += simulation.get_num_ship_steps();
+                simulation_seconds +=
+                    std::chrono::duration<double>(ms_clock::now()-simulation_start).count();
+                num_rollouts += NUM_LANES;
+                for (int possible_move = 0; possible_move < NUM_LANES; possible_move++) {
+                    for (size_t ship_idx=0; ship_idx < trees.size(); ship_idx++) {
+                        simulation_moves.push_temp(ship_idx, possible_move);
+                        update(ship_idx, possible_move);
+                        simulation_moves.pop(ship_idx);
                     }
-                    break;
+                }
             }
-        }
-    }
 
-    void add_inspiration(std::vector<int>& inspiration_grid, int position, int amount) {
-        if (INSPIRATION_ENABLED) {
-            int radius = hlt::constants::INSPIRATION_RADIUS;
-            for (int dx=-(radius-1); dx < radius; dx++) {
-                int y_range = radius-1-std::abs(dx);
-                for (int dy=-y_range; dy <= y_range; dy++) {
-                    inspiration_grid[move_position(position, dx, dy)] += amount;
+            if (virtual_loss != 0) {
+                for (size_t ship_idx=0; ship_idx < trees.size(); ship_idx++) {
+                    if (is_frozen[ship_idx]) { continue; }
+                    trees[ship_idx].remove_virtual_loss(simulation_moves, ship_idx, virtual_loss);
                 }
             }
+/*
+            for (size_t ship_idx=0; ship_idx < trees.size(); ship_idx++) {
+                std::cerr << trees[ship_idx] << std::endl;
+            }
+*/
         }
+#ifdef DEBUG
+        std::cerr << "iterations: " << num_iterations  << std::endl;
+#endif
     }
 };
 
-MctsBot::MctsBot(unsigned int seed)
-  : generator(seed),
-    mining_grid(0, 0)
+MctsBotArgs::MctsBotArgs()
+  : num_threads(std::max(1u, std::thread::hardware_concurrency())),
+    parallel_mode(ParallelMode::Root),
+    max_tree_nodes(1 << 22),
+    inspiration_enabled(true),
+    min_rollouts(2000),
+    min_rollout_depth(10),
+    search_enemy_ships(true),
+    cull_far_ships(true),
+    transpositions_enabled(true),
+    priors_enabled(true),
+    rave_enabled(false),
+    freeze_converged_trees(true),
+    sequential_halving(false),
+    leaf_evaluator_enabled(false),
+    truncated_rollouts(false),
+    rollout_tail(5),
+    common_random_numbers(false),
+    stability_experiment(false),
+    benchmark_policies(false),
+    benchmark_inspiration(false),
+    pondering(false),
+    max_iterations(0),
+    telemetry_enabled(false)
 {
 }
 
+MctsBot::MctsBot(unsigned int seed, MctsBotArgs args)
+  : args(args),
+    generator(seed),
+    mining_grid(0, 0),
+    seconds_per_ship_turn(0),
+    is_ponder_stopped(false),
+    rollouts_before_pondering(0)
+{
+}
+
+MctsBot::~MctsBot() {
+    stop_pondering();
+}
+
 void MctsBot::init(hlt::Game& game) {
     auto& map = *game.game_map;
 
+    // Allocate the trees up front, two pools for each set of trees.
+    size_t num_pools = (args.parallel_mode == ParallelMode::Tree) ? 1 : args.num_threads;
+    int pool_capacity = args.max_tree_nodes/(2*num_pools);
+    for (size_t pool_idx=0; pool_idx < num_pools; pool_idx++) {
+        node_pools.push_back(std::make_unique<MctsNodePool>(pool_capacity));
+        last_node_pools.push_back(std::make_unique<MctsNodePool>(pool_capacity));
+        if (args.transpositions_enabled) {
+            // Only leaves that get children are stored, one for every five nodes.
+            transposition_tables.push_back(
+                std::make_unique<TranspositionTable>(pool_capacity/4));
+        }
+    }
+    last_roots.resize(num_pools);
+
     mining_grid = GravityGrid(map.width, map.height);
     for (int y=0; y < map.height; y++) {
         for (int x=0; x < map.width; x++) {
@@ -747,9 +360,23 @@ void MctsBot::init(hlt::Game& game) {
         return_grids.push_back(grid);
     }
 
+    if (args.telemetry_enabled) {
+        telemetry_file.open("telemetry-" + std::to_string(game.my_id) + ".jsonl");
+    }
+
     game.ready("mcts");
 }
 
+// Find the move that took a ship from one position to another, or -1 if there is none.
+int find_move(const Frame& frame, hlt::Position from, hlt::Position to) {
+    for (size_t move = 0; move < ALL_DIRECTIONS.size(); move++) {
+        if (frame.move(from, ALL_DIRECTIONS[move]) == to) {
+            return move;
+        }
+    }
+    return -1;
+}
+
 void MctsBot::maintain(const hlt::Game& game) {
     auto& game_map = *game.game_map;
     // Update the existing gravity grid so no significant time is spend on it each turn.
@@ -774,23 +401,261 @@ void MctsBot::maintain(const hlt::Game& game) {
     }
 }
 
+// Time a rollout step with the policies and with the table computed from them, and log the results.
+void benchmark_policies(
+    Rng& generator,
+    const Frame& frame,
+    std::vector<MovePolicy>& move_policies,
+    const PolicyTable& policy_table
+) {
+    const int NUM_STEPS = 1 << 20;
+    const int NUM_INPUTS = 1 << 12;
+
+    auto& game_map = *frame.get_game().game_map;
+    int board_size = game_map.width*game_map.height;
+    std::vector<hlt::Halite> cell_halite(board_size);
+    hlt::Halite total_halite = 0;
+    for (int y=0; y < game_map.height; y++) {
+        for (int x=0; x < game_map.width; x++) {
+            hlt::Position pos(x, y);
+            cell_halite[frame.get_index(pos)] = game_map.at(pos)->halite;
+            total_halite += cell_halite[frame.get_index(pos)];
+        }
+    }
+    MiningPolicy mining_policy(board_size);
+
+    // The inputs are drawn up front, so that only the policies are timed.
+    std::vector<int> positions(NUM_INPUTS);
+    std::vector<int> players(NUM_INPUTS);
+    std::vector<hlt::Halite> ship_halite(NUM_INPUTS);
+    for (int i=0; i < NUM_INPUTS; i++) {
+        positions[i] = generator()%board_size;
+        players[i] = generator()%move_policies.size();
+        ship_halite[i] = generator()%(hlt::constants::MAX_HALITE+1);
+    }
+    bool allowed_moves[4] = { true, true, true, true };
+
+    // The sums of the moves keep the loops from being optimized away, and show that both
+    // choose similar moves.
+    long long reference_sum = 0;
+    auto start = ms_clock::now();
+    for (int step=0; step < NUM_STEPS; step++) {
+        int i = step%NUM_INPUTS;
+        int position = positions[i];
+        if (!mining_policy.should_mine(generator, cell_halite[position], total_halite)) {
+            reference_sum += move_policies[players[i]].get_move(
+                generator, position, ship_halite[i], allowed_moves);
+        }
+    }
+    float reference_seconds = std::chrono::duration<float>(ms_clock::now()-start).count();
+
+    long long table_sum = 0;
+    start = ms_clock::now();
+    for (int step=0; step < NUM_STEPS; step++) {
+        int i = step%NUM_INPUTS;
+        int position = positions[i];
+        uint32_t random = generator();
+        if (!policy_table.should_mine(cell_halite[position], random)) {
+            table_sum += policy_table.get_move(
+                players[i], position, ship_halite[i], allowed_moves, random);
+        }
+    }
+    float table_seconds = std::chrono::duration<float>(ms_clock::now()-start).count();
+
+    hlt::log::log("policy benchmark: reference "
+        + std::to_string(reference_seconds*1e9/NUM_STEPS) + " ns/step, table "
+        + std::to_string(table_seconds*1e9/NUM_STEPS) + " ns/step, move sums "
+        + std::to_string(reference_sum) + " " + std::to_string(table_sum));
+}
+
+// Time batches of rollouts of the frame without given moves, with and without inspiration, and
+// log the results.
+void benchmark_inspiration(
+    Rng& generator,
+    const Frame& frame,
+    const std::vector<SimulatedShip>& ships,
+    const PolicyTable& policy_table,
+    int rollout_depth
+) {
+    const int NUM_BATCHES = 200;
+
+    ShipMoves moves(ships.size(), 0);
+    std::vector<float> res;
+    float rollouts_per_second[2];
+    for (bool inspiration_enabled : { false, true }) {
+        MctsSimulation simulation(generator, frame, ships, policy_table, inspiration_enabled);
+        auto start = ms_clock::now();
+        for (int batch=0; batch < NUM_BATCHES; batch++) {
+            simulation.run_batch(moves, rollout_depth, res);
+        }
+        float seconds = std::chrono::duration<float>(ms_clock::now()-start).count();
+        rollouts_per_second[inspiration_enabled] = NUM_BATCHES*NUM_LANES/seconds;
+    }
+
+    hlt::log::log("inspiration benchmark: off "
+        + std::to_string((int)rollouts_per_second[0]) + " rollouts/s, on "
+        + std::to_string((int)rollouts_per_second[1]) + " rollouts/s, depth "
+        + std::to_string(rollout_depth));
+}
+
+// Search the same frame several times for each number of iterations, with and without common
+// random numbers, and log how often the searches choose the same moves for own ships.
+void run_stability_experiment(
+    Rng& generator,
+    const Frame& frame,
+    const std::vector<SimulatedShip>& ships,
+    size_t num_searched_ships,
+    const std::vector<float>& comparison_scores,
+    const PolicyTable& policy_table,
+    bool inspiration_enabled,
+    int rollout_depth
+) {
+    const int NUM_SEARCHES = 8;
+    const int ITERATION_COUNTS[] = { 25, 50, 100, 200, 400 };
+
+    MctsNodePool pool(1 << 20);
+    for (bool common_random_numbers : { false, true }) {
+        for (int num_iterations : ITERATION_COUNTS) {
+            // The number of searches that chose each move, for each ship.
+            std::vector<std::array<int, 5>> move_counts(num_searched_ships);
+            for (int search=0; search < NUM_SEARCHES; search++) {
+                pool.clear();
+                std::vector<MctsTree> trees;
+                for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+                    trees.emplace_back(comparison_scores[ship_idx], pool);
+                }
+                MctsWorker worker(
+                    generator.split(),
+                    frame,
+                    ships,
+                    policy_table,
+                    inspiration_enabled,
+                    common_random_numbers,
+                    false,
+                    trees,
+                    0,
+                    rollout_depth,
+                    0,
+                    false,
+                    false);
+                worker.search(time_point::max(), num_iterations);
+
+                for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+                    std::array<int, 5> root_visits = {};
+                    trees[ship_idx].add_root_visits(root_visits);
+                    auto best = std::max_element(root_visits.begin(), root_visits.end());
+                    move_counts[ship_idx][best-root_visits.begin()]++;
+                }
+            }
+
+            // Agreement with the move chosen most often, over the own ships.
+            int num_agreeing = 0;
+            int num_decisions = 0;
+            for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+                if (ships[ship_idx].player != frame.get_game().my_id) { continue; }
+                num_agreeing += *std::max_element(
+                    move_counts[ship_idx].begin(), move_counts[ship_idx].end());
+                num_decisions += NUM_SEARCHES;
+            }
+            if (num_decisions == 0) { return; }
+            hlt::log::log("stability: common random numbers "
+                + std::string(common_random_numbers ? "on" : "off")
+                + ", iterations: " + std::to_string(num_iterations)
+                + ", agreement: " + std::to_string(((float)num_agreeing)/num_decisions));
+        }
+    }
+}
+
+// Remove the ships that can not affect any searched ship during a rollout, neither directly nor
+// through other ships: those not connected to a searched ship by a chain of ships that are each
+// within interaction_distance of the next. The kept ships are exactly those the searched ships can
+// interact with, so the rollouts play out the same. The searched ships are always kept at the
+// front, and the order of the others is kept.
+void cull_far_ships(
+    hlt::GameMap& game_map,
+    std::vector<std::shared_ptr<hlt::Ship>>& ships,
+    size_t num_searched_ships,
+    int interaction_distance
+) {
+    std::vector<bool> is_kept(ships.size());
+    // Kept ships whose neighbors have not been looked for yet.
+    std::vector<size_t> open_ships;
+    for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+        is_kept[ship_idx] = true;
+        open_ships.push_back(ship_idx);
+    }
+    while (!open_ships.empty()) {
+        auto position = ships[open_ships.back()]->position;
+        open_ships.pop_back();
+        for (size_t ship_idx=num_searched_ships; ship_idx < ships.size(); ship_idx++) {
+            if (is_kept[ship_idx]) { continue; }
+            int distance = game_map.calculate_distance(position, ships[ship_idx]->position);
+            if (distance <= interaction_distance) {
+                is_kept[ship_idx] = true;
+                open_ships.push_back(ship_idx);
+            }
+        }
+    }
+
+    size_t num_kept = 0;
+    for (size_t ship_idx=0; ship_idx < ships.size(); ship_idx++) {
+        if (is_kept[ship_idx]) {
+            ships[num_kept] = ships[ship_idx];
+            num_kept++;
+        }
+    }
+    ships.resize(num_kept);
+}
+
+int MctsBot::get_rollout_depth(int num_ships, time_point end_time) const {
+    if (args.max_iterations != 0 || seconds_per_ship_turn <= 0 || num_ships == 0) {
+        return MAX_DEPTH;
+    }
+    float seconds = std::chrono::duration<float>(end_time-ms_clock::now()).count();
+    float num_batches = ((float)args.min_rollouts)/NUM_LANES;
+    float depth = seconds*args.num_threads/(num_batches*num_ships*seconds_per_ship_turn);
+    return std::max(args.min_rollout_depth, std::min(MAX_DEPTH, (int)depth));
+}
+
 std::vector<hlt::Command> MctsBot::run(const hlt::Game& game, time_point end_time) {
 #ifdef DEBUG
     if (game.turn_number > 10) { throw "die"; }
     std::cerr << "turn: " << game.turn_number << std::endl;
 #endif
+    stop_pondering();
+    auto maintain_start = ms_clock::now();
     maintain(game);
+    double maintain_seconds =
+        std::chrono::duration<double>(ms_clock::now()-maintain_start).count();
 
     Frame frame(game);
     int turns_left = hlt::constants::MAX_TURNS-game.turn_number;
 
-    // Get list of all ships
+    // Get list of all ships, with own ships first. Only the first num_searched_ships ships get
+    // search trees, the others only follow the rollout policy.
     std::vector<std::shared_ptr<hlt::Ship>> all_ships;
+    for (auto id_ship : game.me->ships) {
+        all_ships.push_back(id_ship.second);
+    }
     for (auto player : game.players) {
+        if (player->id == game.my_id) { continue; }
         for (auto id_ship : player->ships) {
             all_ships.push_back(id_ship.second);
         }
     }
+    size_t num_searched_ships = args.search_enemy_ships ? all_ships.size() : game.me->ships.size();
+    size_t num_ships = all_ships.size();
+
+    int rollout_depth = get_rollout_depth(all_ships.size(), end_time);
+    bool inspiration_enabled = args.inspiration_enabled && hlt::constants::INSPIRATION_ENABLED;
+    if (args.cull_far_ships && num_searched_ships < all_ships.size()) {
+        // Ships meet or block each other within one cell, and inspire each other within the
+        // inspiration radius, after both have moved for the whole rollout.
+        int interaction_distance = 2*rollout_depth
+            + std::max(1, inspiration_enabled ? hlt::constants::INSPIRATION_RADIUS : 0);
+        cull_far_ships(*game.game_map, all_ships, num_searched_ships, interaction_distance);
+    }
+
     std::vector<SimulatedShip> simulation_ships;
     for (auto ship : all_ships) {
         SimulatedShip simulated(
@@ -807,86 +672,237 @@ std::vector<hlt::Command> MctsBot::run(const hlt::Game& game, time_point end_tim
     for (size_t player_idx=0; player_idx < game.players.size(); player_idx++) {
         move_policies.push_back(MovePolicy(GravityPolicy(mining_grid, return_grids[player_idx])));
     }
-    MctsSimulation simulation(generator, frame, simulation_ships, move_policies);
-
-    ShipMoves simulation_moves(all_ships.size());
+    policy_table = std::make_unique<PolicyTable>(frame, move_policies);
+    if (args.benchmark_policies) {
+        benchmark_policies(generator, frame, move_policies, *policy_table);
+    }
+    // Truncated rollouts end far from the horizon, where returning with the current halite is a
+    // poor estimate.
+    bool use_leaf_evaluator = args.leaf_evaluator_enabled || args.truncated_rollouts;
+    MctsSimulation simulation(
+        generator,
+        frame,
+        simulation_ships,
+        *policy_table,
+        inspiration_enabled,
+        false,
+        use_leaf_evaluator);
+
+    ShipMoves simulation_moves(all_ships.size(), num_searched_ships);
     // Run simulations where no moves have been specified.
     // Only used to initialize expectations for ships at dropoffs as its expectation is of lower quality.
     std::vector<float> simulation_score_sum(all_ships.size());
+    std::vector<float> res;
     for (int i=0; i < NUM_INIT_SIMULATIONS; i++) {
-        auto res = simulation.run(simulation_moves, MAX_DEPTH);
+        simulation.run(simulation_moves, rollout_depth, res);
         for (size_t ship_idx=0; ship_idx < res.size(); ship_idx++) {
             simulation_score_sum[ship_idx] += res[ship_idx];
         }
     }
 
-    // Setup mcts trees
-    std::vector<MctsTree> mcts_trees;
-    for (size_t ship_idx=0; ship_idx < simulation_ships.size(); ship_idx++) {
+    // Setup comparison scores for the mcts trees
+    std::vector<float> comparison_scores;
+    for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
         float comparison_score = 0;
         if (simulation_ships[ship_idx].turns_underway == 0) {
             comparison_score = simulation_score_sum[ship_idx]/NUM_INIT_SIMULATIONS;
         } else {
             comparison_score = last_average_scores[all_ships[ship_idx]->id];
         }
-        mcts_trees.emplace_back(comparison_score);
+        comparison_scores.push_back(comparison_score);
     }
 
-    // Run simulations and update trees
-    int depth = 0;
-    for (auto now = ms_clock::now(); now < end_time; now = ms_clock::now()) {
-#ifdef DEBUG
-        if (depth == 10) break;
-#endif
-        depth++;
+    if (args.stability_experiment) {
+        run_stability_experiment(
+            generator,
+            frame,
+            simulation_ships,
+            num_searched_ships,
+            comparison_scores,
+            *policy_table,
+            inspiration_enabled,
+            rollout_depth);
+    }
+    if (args.benchmark_inspiration) {
+        benchmark_inspiration(generator, frame, simulation_ships, *policy_table, rollout_depth);
+    }
 
-        for (size_t ship_idx=0; ship_idx < mcts_trees.size(); ship_idx++) {
-            // Sets the move in the ShipMoves buffer
-            mcts_trees[ship_idx].tree_policy(simulation_moves, ship_idx);
+    // The moves that were actually taken last turn, after collision avoidance.
+    std::vector<int> last_moves(all_ships.size(), -1);
+    for (size_t ship_idx=0; ship_idx < all_ships.size(); ship_idx++) {
+        auto it = last_positions.find(all_ships[ship_idx]->id);
+        if (it != last_positions.end()) {
+            last_moves[ship_idx] = find_move(frame, it->second, all_ships[ship_idx]->position);
         }
-        //std::cerr << simulation_moves << std::endl;
+    }
 
-        for (size_t possible_move = 0; possible_move < ALL_DIRECTIONS.size(); possible_move++) {
-            for (size_t ship_idx=0; ship_idx < mcts_trees.size(); ship_idx++) {
-                simulation_moves.push_temp(ship_idx, possible_move);
+    // Setup mcts trees. With root parallelization every worker searches its own trees,
+    // otherwise all workers share a single set of trees.
+    // The trees continue from the subtrees of the moves taken last turn, which are moved to the
+    // cleared pool. Trees of destroyed ships are dropped.
+    bool is_tree_parallel = (args.parallel_mode == ParallelMode::Tree);
+    bool follow_paths = args.transpositions_enabled || args.priors_enabled;
+    if (follow_paths) { path_model.reset(frame); }
+    tree_sets.clear();
+    tree_sets.resize(node_pools.size());
+    for (size_t pool_idx=0; pool_idx < node_pools.size(); pool_idx++) {
+        std::swap(node_pools[pool_idx], last_node_pools[pool_idx]);
+        auto& pool = *node_pools[pool_idx];
+        auto& last_pool = *last_node_pools[pool_idx];
+        pool.clear();
+        TranspositionTable* transpositions = nullptr;
+        if (args.transpositions_enabled) {
+            transpositions = transposition_tables[pool_idx].get();
+            transpositions->reset();
+        }
+        // Since the reused subtrees take at most half of the pool, there is room for a new root
+        // for every tree that can not continue from its last one.
+        int max_reused_nodes =
+            MAX_REUSED_SHARE*pool.get_capacity()/std::max(num_searched_ships, (size_t)1);
+        for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+            NodeIndex root = NO_NODE;
+            auto it = last_roots[pool_idx].find(all_ships[ship_idx]->id);
+            if (it != last_roots[pool_idx].end() && last_moves[ship_idx] != -1) {
+                NodeIndex last_child = last_pool.get_child(it->second, last_moves[ship_idx]);
+                if (last_child != NO_NODE) {
+                    root = pool.copy_subtree(last_pool, last_child, max_reused_nodes);
+                }
             }
+            tree_sets[pool_idx].emplace_back(
+                comparison_scores[ship_idx],
+                pool,
+                root,
+                follow_paths ? &path_model : nullptr,
+                transpositions,
+                args.priors_enabled ? policy_table.get() : nullptr,
+                simulation_ships[ship_idx].player,
+                simulation_ships[ship_idx].position,
+                simulation_ships[ship_idx].halite,
+                args.rave_enabled);
+        }
+    }
 
-            if (ISOLATE_SHIPS) {
-                for (size_t ship_idx=0; ship_idx < mcts_trees.size(); ship_idx++) {
-                    simulation_moves.isolate(ship_idx);
-                    auto results = simulation.run(simulation_moves, MAX_DEPTH);
-                    mcts_trees[ship_idx].update(simulation_moves, ship_idx, results[ship_idx]);
-                }
+    // The rounds of sequential halving are kept in the trees without synchronization, so they
+    // are only used when every worker has its own trees. The trees are not frozen by visits,
+    // which sequential halving spreads on purpose.
+    bool use_halving = args.sequential_halving && !is_tree_parallel;
+
+    // The first worker runs on this thread.
+    auto search_start = ms_clock::now();
+    workers.clear();
+    workers.resize(args.num_threads);
+    auto run_worker = [&](int worker_idx, Rng worker_generator) {
+        workers[worker_idx] = std::make_unique<MctsWorker>(
+            worker_generator,
+            frame,
+            simulation_ships,
+            *policy_table,
+            inspiration_enabled,
+            args.common_random_numbers,
+            use_leaf_evaluator,
+            tree_sets[is_tree_parallel ? 0 : worker_idx],
+            is_tree_parallel ? VIRTUAL_LOSS : 0,
+            rollout_depth,
+            args.truncated_rollouts ? args.rollout_tail : 0,
+            args.freeze_converged_trees && !use_halving,
+            use_halving);
+        if (args.max_iterations != 0) {
+            workers[worker_idx]->search(time_point::max(), args.max_iterations);
+        } else {
+            workers[worker_idx]->search(end_time);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int worker_idx=1; worker_idx < args.num_threads; worker_idx++) {
+        threads.emplace_back(run_worker, worker_idx, generator.split());
+    }
+    run_worker(0, generator.split());
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Rollout throughput, to compare settings across games.
+    int num_rollouts = 0;
+    long long num_batch_turns = 0;
+    long long num_skipped_paths = 0;
+    for (auto& worker : workers) {
+        num_rollouts += worker->num_rollouts;
+        num_batch_turns += worker->num_batch_turns;
+        num_skipped_paths += worker->num_skipped_paths;
+    }
+    // The share of the paths that were not searched because their trees were frozen.
+    float frozen_share = num_searched_ships > 0 && num_rollouts > 0
+        ? ((float)num_skipped_paths)*NUM_LANES/(num_rollouts*num_searched_ships)
+        : 0;
+    float search_seconds = std::chrono::duration<float>(ms_clock::now()-search_start).count();
+    int num_nodes = 0;
+    for (auto& pool : node_pools) {
+        num_nodes += pool->get_size();
+    }
+    if (num_batch_turns > 0 && num_ships > 0) {
+        // Per ship on the board, so that the depth also adapts to the ships that are culled.
+        float measured = search_seconds*args.num_threads/(num_batch_turns*num_ships);
+        // Averaged with the previous turns, since the time per turn also depends on the depth.
+        seconds_per_ship_turn = (seconds_per_ship_turn > 0)
+            ? (seconds_per_ship_turn+measured)/2
+            : measured;
+    }
+    hlt::log::log("rollouts: " + std::to_string(num_rollouts)
+        + ", per second: " + std::to_string((int)(num_rollouts/search_seconds))
+        + ", ships: " + std::to_string(num_ships)
+        + ", simulated: " + std::to_string(all_ships.size())
+        + ", searched: " + std::to_string(num_searched_ships)
+        + ", depth: " + std::to_string(rollout_depth)
+        + ", nodes: " + std::to_string(num_nodes)
+        + ", frozen: " + std::to_string(frozen_share)
+        + ", inspiration: " + (inspiration_enabled ? "on" : "off"));
+
+    // Merge the statistics of all trees and workers.
+    std::vector<std::array<int, 5>> root_visits(num_searched_ships);
+    std::vector<float> average_scores(num_searched_ships);
+    for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+        for (auto& trees : tree_sets) {
+            if (use_halving) {
+                // Each set of trees votes for its choice with all of its visits.
+                std::array<int, 5> visits = {};
+                trees[ship_idx].add_root_visits(visits);
+                root_visits[ship_idx][trees[ship_idx].get_halving_choice()] +=
+                    std::accumulate(visits.begin(), visits.end(), 0);
             } else {
-                auto results = simulation.run(simulation_moves, MAX_DEPTH);
-                for (size_t ship_idx=0; ship_idx < mcts_trees.size(); ship_idx++) {
-                    mcts_trees[ship_idx].update(simulation_moves, ship_idx, results[ship_idx]);
-                }
-            }
-            for (size_t ship_idx=0; ship_idx < mcts_trees.size(); ship_idx++) {
-                simulation_moves.pop(ship_idx);
+                trees[ship_idx].add_root_visits(root_visits[ship_idx]);
             }
         }
-/*
-        for (size_t ship_idx=0; ship_idx < mcts_trees.size(); ship_idx++) {
-            std::cerr << mcts_trees[ship_idx] << std::endl;
+        float score_sum = 0;
+        int num_scores = 0;
+        for (auto& worker : workers) {
+            score_sum += worker->score_sums[ship_idx];
+            num_scores += worker->num_scores[ship_idx];
         }
-*/
+        average_scores[ship_idx] = num_scores > 0 ? score_sum/num_scores : 0;
     }
-#ifdef DEBUG
-    std::cerr << "depth: " << depth  << std::endl;
-#endif
 
     // Update last_average_scores
-    for (size_t ship_idx=0; ship_idx < all_ships.size(); ship_idx++) {
-        last_average_scores[all_ships[ship_idx]->id] = mcts_trees[ship_idx].get_average_score();
+    for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+        last_average_scores[all_ships[ship_idx]->id] = average_scores[ship_idx];
+    }
+
+    // Keep the trees for the next turn
+    last_positions.clear();
+    for (auto ship : all_ships) {
+        last_positions.insert({ ship->id, ship->position });
+    }
+    for (size_t pool_idx=0; pool_idx < node_pools.size(); pool_idx++) {
+        last_roots[pool_idx].clear();
+        for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+            last_roots[pool_idx][all_ships[ship_idx]->id] = tree_sets[pool_idx][ship_idx].root;
+        }
     }
 
     float halite_per_turn_sum = 0;
     std::unordered_map<hlt::EntityId, hlt::Direction> own_moves;
-    for (size_t ship_idx=0; ship_idx < all_ships.size(); ship_idx++) {
+    for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
         if (all_ships[ship_idx]->owner == game.my_id) {
-            auto move = mcts_trees[ship_idx].best_move();
+            auto move = most_visited_move(root_visits[ship_idx]);
             auto cell_halite = game.game_map->at(all_ships[ship_idx]->position)->halite;
             auto ship_halite = all_ships[ship_idx]->halite;
             // It is possible that ships can not take the desired move,
@@ -895,7 +911,7 @@ std::vector<hlt::Command> MctsBot::run(const hlt::Game& game, time_point end_tim
                 move = hlt::Direction::STILL;
             }
             own_moves[all_ships[ship_idx]->id] = move;
-            halite_per_turn_sum += mcts_trees[ship_idx].get_average_score();
+            halite_per_turn_sum += average_scores[ship_idx];
         }
     }
     // Otherwise it might build ships in the last turn if suicide strat is successful.
@@ -908,7 +924,10 @@ std::vector<hlt::Command> MctsBot::run(const hlt::Game& game, time_point end_tim
             spawn_desired = false;
         }
     }
+    auto collision_start = ms_clock::now();
     auto collision_res = frame.avoid_collisions(own_moves, turns_left < 15, spawn_desired);
+    double collision_seconds =
+        std::chrono::duration<double>(ms_clock::now()-collision_start).count();
 
     std::vector<hlt::Command> commands;
     for (auto id_ship : game.me->ships) {
@@ -917,5 +936,149 @@ std::vector<hlt::Command> MctsBot::run(const hlt::Game& game, time_point end_tim
     if (collision_res.is_spawn_possible) {
         commands.push_back(game.me->shipyard->spawn());
     }
+
+    // The index of the move sent for each searched own ship, or -1 for the other ships.
+    std::vector<int> sent_moves(num_searched_ships, -1);
+    planned_moves.clear();
+    for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+        auto it = collision_res.safe_moves.find(all_ships[ship_idx]->id);
+        if (it == collision_res.safe_moves.end()) { continue; }
+        sent_moves[ship_idx] = std::find(ALL_DIRECTIONS.begin(), ALL_DIRECTIONS.end(), it->second)
+            - ALL_DIRECTIONS.begin();
+        std::array<int, 5> next_visits = {};
+        for (auto& trees : tree_sets) {
+            trees[ship_idx].add_next_visits(sent_moves[ship_idx], next_visits);
+        }
+        planned_moves[it->first] = most_visited_move(next_visits);
+    }
+
+    if (args.telemetry_enabled) {
+        write_telemetry(
+            game.turn_number,
+            all_ships.size(),
+            rollout_depth,
+            root_visits,
+            maintain_seconds,
+            search_seconds,
+            collision_seconds);
+    }
+
+    // The rollouts of pondering depend on how long the next frame takes. After the last turn
+    // there is no next frame, only the end of the input.
+    bool is_last_turn = game.turn_number >= hlt::constants::MAX_TURNS;
+    if (args.pondering && args.max_iterations == 0 && !is_last_turn) {
+        start_pondering(sent_moves);
+    }
     return commands;
 }
+
+void MctsBot::write_telemetry(
+    int turn_number,
+    int num_simulated_ships,
+    int rollout_depth,
+    const std::vector<std::array<int, 5>>& root_visits,
+    double maintain_seconds,
+    double search_seconds,
+    double collision_seconds
+) {
+    int num_batches = 0;
+    int num_rollouts = 0;
+    long long num_ship_steps = 0;
+    double simulation_seconds = 0;
+    for (auto& worker : workers) {
+        num_batches += worker->num_batches;
+        num_rollouts += worker->num_rollouts;
+        num_ship_steps += worker->num_ship_steps;
+        simulation_seconds += worker->simulation_seconds;
+    }
+
+    // The shape of the trees of each searched ship, summed over the sets of trees.
+    size_t num_searched_ships = root_visits.size();
+    std::vector<int> tree_nodes(num_searched_ships);
+    std::vector<int> tree_depths(num_searched_ships);
+    for (size_t pool_idx=0; pool_idx < tree_sets.size(); pool_idx++) {
+        std::vector<char> visited(node_pools[pool_idx]->get_size());
+        for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+            int num_nodes;
+            int max_depth;
+            tree_sets[pool_idx][ship_idx].get_shape(visited, num_nodes, max_depth);
+            tree_nodes[ship_idx] += num_nodes;
+            tree_depths[ship_idx] = std::max(tree_depths[ship_idx], max_depth);
+        }
+    }
+
+    auto& out = telemetry_file;
+    out << "{\"turn\": " << turn_number
+        << ", \"simulated_ships\": " << num_simulated_ships
+        << ", \"rollout_depth\": " << rollout_depth
+        << ", \"iterations\": " << num_batches
+        << ", \"rollouts\": " << num_rollouts
+        << ", \"ship_steps\": " << num_ship_steps
+        << ", \"rollouts_per_second\": " << (search_seconds > 0 ? num_rollouts/search_seconds : 0)
+        << ", \"maintain_ms\": " << 1000*maintain_seconds
+        << ", \"search_ms\": " << 1000*search_seconds
+        << ", \"simulation_ms\": " << 1000*simulation_seconds
+        << ", \"avoid_collisions_ms\": " << 1000*collision_seconds;
+    out << ", \"tree_nodes\": [";
+    for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+        out << (ship_idx == 0 ? "" : ", ") << tree_nodes[ship_idx];
+    }
+    out << "], \"tree_depths\": [";
+    for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+        out << (ship_idx == 0 ? "" : ", ") << tree_depths[ship_idx];
+    }
+    // In bits, from 0 when all visits go to one move up to log2(5) when they are spread evenly.
+    out << "], \"root_entropy\": [";
+    for (size_t ship_idx=0; ship_idx < num_searched_ships; ship_idx++) {
+        int total_visits = std::accumulate(
+            root_visits[ship_idx].begin(), root_visits[ship_idx].end(), 0);
+        float entropy = 0;
+        for (int visits : root_visits[ship_idx]) {
+            if (visits == 0) { continue; }
+            float p = ((float)visits)/total_visits;
+            entropy -= p*std::log2(p);
+        }
+        out << (ship_idx == 0 ? "" : ", ") << entropy;
+    }
+    // Flushed, as the bot exits without unwinding when the game ends.
+    out << "]}" << std::endl;
+}
+
+const std::unordered_map<hlt::EntityId, hlt::Direction>& MctsBot::get_planned_moves() const {
+    return planned_moves;
+}
+
+void MctsBot::start_pondering(const std::vector<int>& fixed_moves) {
+    for (auto& trees : tree_sets) {
+        for (size_t ship_idx=0; ship_idx < fixed_moves.size(); ship_idx++) {
+            if (fixed_moves[ship_idx] == -1) { continue; }
+            trees[ship_idx].fix_root_move(fixed_moves[ship_idx]);
+        }
+    }
+    rollouts_before_pondering = 0;
+    for (auto& worker : workers) {
+        rollouts_before_pondering += worker->num_rollouts;
+        worker->start_pondering();
+    }
+    is_ponder_stopped.store(false);
+    for (size_t worker_idx=0; worker_idx < workers.size(); worker_idx++) {
+        ponder_threads.emplace_back([this, worker_idx]() {
+            workers[worker_idx]->search(time_point::max(), INT32_MAX, &is_ponder_stopped);
+        });
+    }
+}
+
+void MctsBot::stop_pondering() {
+    if (ponder_threads.empty()) { return; }
+    is_ponder_stopped.store(true);
+    for (auto& thread : ponder_threads) {
+        thread.join();
+    }
+    ponder_threads.clear();
+
+    int num_rollouts = -rollouts_before_pondering;
+    for (auto& worker : workers) {
+        num_rollouts += worker->num_rollouts;
+    }
+    hlt::log::log("pondered rollouts: " + std::to_string(num_rollouts));
+}
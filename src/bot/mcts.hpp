@@ -2,27 +2,165 @@
 
 #include "bot/bot.hpp"
 #include "bot/gravity_grid.hpp"
+#include "bot/mcts_tree.hpp"
+#include "bot/random.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+enum class ParallelMode {
+    // Each thread searches its own trees, and the root statistics are merged before a move is
+    // chosen.
+    Root,
+    // All threads search the same trees, using virtual loss to make them take different paths.
+    Tree
+};
+
+struct MctsBotArgs {
+    // Number of threads that search in parallel. Each thread owns its own simulation.
+    int num_threads;
+    // How the threads share the search trees.
+    ParallelMode parallel_mode;
+    // Total number of tree nodes, allocated once and split between the sets of trees.
+    // Half of them are used to keep the trees from the previous turn.
+    int max_tree_nodes;
+    // Whether rollouts simulate inspiration, if the game has it enabled.
+    bool inspiration_enabled;
+    // Number of rollouts each turn should reach. The rollouts are made shorter than MAX_DEPTH
+    // when the speed measured in the previous turn would not allow it, but not below
+    // min_rollout_depth.
+    int min_rollouts;
+    int min_rollout_depth;
+    // Whether enemy ships get search trees. Otherwise they only follow the rollout policy, and
+    // all of the search goes to own ships.
+    bool search_enemy_ships;
+    // Whether ships that can not affect any searched ship within a rollout, directly or through
+    // other ships, are left out of the rollouts. Only has an effect when enemy ships are not
+    // searched, as searched ships are always simulated.
+    bool cull_far_ships;
+    // Whether paths of a tree that reach the same cell at the same depth with about the same
+    // halite share their children and statistics.
+    bool transpositions_enabled;
+    // Whether new children get the rollout policy as priors, which steer the selection towards
+    // likely moves before they have been visited.
+    bool priors_enabled;
+    // Whether selection also ranks moves by their rewards when taken at any later depth of a
+    // path, which ranks them usefully long before they have many visits of their own.
+    bool rave_enabled;
+    // Whether a tree stops being searched once its most visited root move can not be overtaken
+    // in the remaining time, leaving the time to the other trees.
+    bool freeze_converged_trees;
+    // Whether the root moves are selected by sequential halving instead of UCT, which spreads a
+    // known budget over the moves in rounds, halving the moves after each round. Only used with
+    // ParallelMode::Root.
+    bool sequential_halving;
+    // Whether ships that have not reached a dropoff at the end of a rollout are scored by
+    // LeafEvaluator, instead of by the time to return with their current halite.
+    bool leaf_evaluator_enabled;
+    // Whether rollouts end rollout_tail turns after the longest path of their batch, rather
+    // than at the rollout depth. Shorter rollouts give more iterations in the same time.
+    // Truncated rollouts are always scored with LeafEvaluator.
+    bool truncated_rollouts;
+    int rollout_tail;
+    // Whether the five rollouts of a batch use the same random numbers for the same ship and turn.
+    bool common_random_numbers;
+    // Whether to measure, each turn before searching, how often repeated searches with a fixed
+    // number of iterations agree on the moves, with and without common random numbers.
+    bool stability_experiment;
+    // Whether to time the rollout policies each turn and log the results.
+    bool benchmark_policies;
+    // Whether to time the rollouts of each turn with and without inspiration and log the results.
+    bool benchmark_inspiration;
+    // Whether the workers keep searching the trees of a turn while waiting for the next frame.
+    // The root moves of own ships are fixed to the moves that were sent, so that the search goes
+    // into the subtrees that the next turn continues from.
+    bool pondering;
+    // If not 0, each worker searches this many batches each turn at the full rollout depth,
+    // regardless of the time. With ParallelMode::Root the commands are then the same for the
+    // same seed and input, which makes runs comparable. Pondering is turned off.
+    int max_iterations;
+    // Whether to write a record of the search of each turn to telemetry-<player id>.jsonl, as one
+    // JSON object per line.
+    bool telemetry_enabled;
+
+    MctsBotArgs();
+};
+
+struct MctsWorker;
 
 class MctsBot : public Bot {
-    // Rng
-    std::mt19937 generator;
+    MctsBotArgs args;
+    // Rng, from which the workers and simulations split their own streams.
+    Rng generator;
     // Grid shared by all players for mining purposes
     GravityGrid mining_grid;
     // Grids for each player used to return to dropoffs
     std::vector<GravityGrid> return_grids;
+    // Storage for the search trees, one pool for each set of trees.
+    std::vector<std::unique_ptr<MctsNodePool>> node_pools;
+    // Pools holding the trees of the previous turn, which are swapped with node_pools each turn.
+    std::vector<std::unique_ptr<MctsNodePool>> last_node_pools;
+    // Transpositions of the trees in node_pools, for each pool, if enabled.
+    std::vector<std::unique_ptr<TranspositionTable>> transposition_tables;
+    // The map that the trees follow their paths on, shared by all trees.
+    PathModel path_model;
+    // The roots of the previous turn's trees in node_pools, for each pool.
+    std::vector<std::unordered_map<hlt::EntityId, NodeIndex>> last_roots;
+    // The positions of all ships in the previous turn.
+    std::unordered_map<hlt::EntityId, hlt::Position> last_positions;
 
     // The number of turns since the ship last visited a dropoff.
     std::unordered_map<hlt::EntityId, int> turns_underway;
     // Average scores of the previous round's simulations.
     // Used to evaluate this rounds scores.
     std::unordered_map<hlt::EntityId, float> last_average_scores;
+    // Time taken by a single thread to simulate one turn of a batch, divided by the number of ships
+    // on the board, as measured in the previous turn. 0 before the first search.
+    float seconds_per_ship_turn;
+
+    // The state of the last search, kept for pondering. The trees and workers refer to the
+    // policy table.
+    std::unique_ptr<PolicyTable> policy_table;
+    std::vector<std::vector<MctsTree>> tree_sets;
+    std::vector<std::unique_ptr<MctsWorker>> workers;
+    std::vector<std::thread> ponder_threads;
+    std::atomic<bool> is_ponder_stopped;
+    // Rollouts of the workers when pondering started.
+    int rollouts_before_pondering;
+    // Receives the telemetry records, if enabled.
+    std::ofstream telemetry_file;
+    // The most visited move of each own ship for the next turn, after the move it was sent.
+    std::unordered_map<hlt::EntityId, hlt::Direction> planned_moves;
 
 public:
-    MctsBot(unsigned int seed);
+    MctsBot(unsigned int seed, MctsBotArgs args);
+    ~MctsBot();
 
     void init(hlt::Game& game);
     std::vector<hlt::Command> run(const hlt::Game& game, time_point end_time);
+    // The moves that the search expects to make next turn, as of the last run.
+    const std::unordered_map<hlt::EntityId, hlt::Direction>& get_planned_moves() const;
+    // Wait for the pondering threads to finish, if pondering. Call before the process exits, as
+    // they search the pools and trees of the bot.
+    void stop_pondering();
 
 private:
     void maintain(const hlt::Game& game);
+    // The rollout depth for which the search can reach min_rollouts.
+    int get_rollout_depth(int num_ships, time_point end_time) const;
+    // Search the trees of the last turn in the background, with the given root move for each
+    // searched ship, or -1 if its root move is not fixed.
+    void start_pondering(const std::vector<int>& fixed_moves);
+    // Write the telemetry record of the turn, after the search.
+    void write_telemetry(
+        int turn_number,
+        int num_simulated_ships,
+        int rollout_depth,
+        const std::vector<std::array<int, 5>>& root_visits,
+        double maintain_seconds,
+        double search_seconds,
+        double collision_seconds
+    );
 };
@@ -0,0 +1,614 @@
+#include "bot/math.hpp"
+#include "bot/mcts_simulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//#define DEBUG
+
+PolicyTable::PolicyTable(const Frame& frame, const std::vector<MovePolicy>& move_policies)
+  : board_size(frame.get_game().game_map->width*frame.get_game().game_map->height),
+    move_weights(move_policies.size()*board_size*NUM_HALITE_BUCKETS*4)
+{
+    auto& game_map = frame.get_game().game_map;
+    hlt::Halite total_halite = 0;
+    hlt::Halite max_cell_halite = 0;
+    for (int y=0; y < game_map->height; y++) {
+        for (int x=0; x < game_map->width; x++) {
+            hlt::Halite cell_halite = game_map->at(hlt::Position(x, y))->halite;
+            total_halite += cell_halite;
+            max_cell_halite = std::max(max_cell_halite, cell_halite);
+        }
+    }
+
+    MiningPolicy mining_policy(board_size);
+    mining_tresholds.resize(max_cell_halite+1);
+    for (hlt::Halite cell_halite=0; cell_halite <= max_cell_halite; cell_halite++) {
+        float treshold = total_halite > 0
+            ? mining_policy.get_treshold(cell_halite, total_halite)
+            : (cell_halite > 0 ? 1 : 0);
+        mining_tresholds[cell_halite] = std::round(std::min(1.0f, treshold)*(1 << 16));
+    }
+
+    for (size_t player=0; player < move_policies.size(); player++) {
+        auto policy = move_policies[player].policy;
+        for (int position=0; position < board_size; position++) {
+            for (int bucket=0; bucket < NUM_HALITE_BUCKETS; bucket++) {
+                hlt::Halite ship_halite =
+                    (bucket*2+1)*hlt::constants::MAX_HALITE/(2*NUM_HALITE_BUCKETS);
+                float weights[4];
+                float sum_weights = 0;
+                for (int move=0; move < 4; move++) {
+                    weights[move] = policy.get_move_weight(move+1, position, ship_halite);
+                    sum_weights += weights[move];
+                }
+                uint16_t* quantized =
+                    &move_weights[((player*board_size+position)*NUM_HALITE_BUCKETS+bucket)*4];
+                for (int move=0; move < 4; move++) {
+                    if (sum_weights <= 0 || weights[move] <= 0) { continue; }
+                    // Moves with any weight stay possible.
+                    quantized[move] = std::max(1.0f,
+                        std::round(weights[move]/sum_weights*(1 << 15)));
+                }
+            }
+        }
+    }
+}
+
+void PolicyTable::get_priors(
+    int player,
+    int position,
+    hlt::Halite current_halite,
+    hlt::Halite cell_halite,
+    float priors[5]
+) const {
+    int bucket = std::min(
+        NUM_HALITE_BUCKETS-1, current_halite*NUM_HALITE_BUCKETS/hlt::constants::MAX_HALITE);
+    const uint16_t* weights =
+        &move_weights[((player*board_size+position)*NUM_HALITE_BUCKETS+bucket)*4];
+    uint32_t sum_weights = 0;
+    for (int move=0; move < 4; move++) {
+        sum_weights += weights[move];
+    }
+
+    // Without any move weights the ship stays still.
+    float mine_probability = 1;
+    if (sum_weights > 0) {
+        hlt::Halite clamped_halite = std::min<hlt::Halite>(cell_halite, mining_tresholds.size()-1);
+        mine_probability = mining_tresholds[clamped_halite]/(float)(1 << 16);
+    }
+    float uniform_prior = PRIOR_UNIFORM_SHARE/ALL_DIRECTIONS.size();
+    priors[STILL_INDEX] = uniform_prior+(1-PRIOR_UNIFORM_SHARE)*mine_probability;
+    for (int move=0; move < 4; move++) {
+        float move_probability = sum_weights == 0
+            ? 0
+            : (1-mine_probability)*weights[move]/sum_weights;
+        priors[move+1] = uniform_prior+(1-PRIOR_UNIFORM_SHARE)*move_probability;
+    }
+}
+
+LeafEvaluator::LeafEvaluator(const Frame& frame) {
+    auto& game_map = *frame.get_game().game_map;
+    area_halite.resize(game_map.width*game_map.height);
+    for (int y=0; y < game_map.height; y++) {
+        for (int x=0; x < game_map.width; x++) {
+            hlt::Halite sum = 0;
+            int num_cells = 0;
+            for (int dy=-LEAF_MINING_RADIUS; dy <= LEAF_MINING_RADIUS; dy++) {
+                int radius_x = LEAF_MINING_RADIUS-std::abs(dy);
+                for (int dx=-radius_x; dx <= radius_x; dx++) {
+                    sum += game_map.at(hlt::Position(x+dx, y+dy))->halite;
+                    num_cells++;
+                }
+            }
+            area_halite[frame.get_index(hlt::Position(x, y))] = ((float)sum)/num_cells;
+        }
+    }
+}
+
+float LeafEvaluator::evaluate(
+    int position,
+    hlt::Halite halite,
+    int turns_underway,
+    int distance_to_dropoff,
+    int turns_left
+) const {
+    float cell_halite = area_halite[position];
+    float return_cost = distance_to_dropoff*cell_halite/hlt::constants::MOVE_COST_RATIO;
+    float max_halite = hlt::constants::MAX_HALITE;
+
+    // The value is a ratio of linear functions of the mining turns, so one of the ends is best.
+    float best = 0;
+    if (distance_to_dropoff <= turns_left) {
+        best = std::max(0.0f, halite-return_cost)/std::max(1, turns_underway+distance_to_dropoff);
+    }
+    float mining_rate = std::max(1.0f, cell_halite/hlt::constants::EXTRACT_RATIO);
+    int mining_turns = std::ceil((max_halite-halite)/mining_rate);
+    if (mining_turns+distance_to_dropoff <= turns_left) {
+        float full = (max_halite-return_cost)/(turns_underway+mining_turns+distance_to_dropoff);
+        best = std::max(best, full);
+    }
+    return best;
+}
+
+MctsSimulation::MctsSimulation(
+    Rng& generator,
+    const Frame& frame,
+    std::vector<SimulatedShip> ships,
+    const PolicyTable& policy_table,
+    bool inspiration_enabled,
+    bool common_random_numbers,
+    bool leaf_evaluator_enabled
+)
+  : turns_left(hlt::constants::MAX_TURNS-frame.get_game().turn_number),
+    width(frame.get_game().game_map->width),
+    height(frame.get_game().game_map->height),
+    board_size(width*height),
+    num_players(frame.get_game().players.size()),
+    original_ships(ships),
+    original_halite(board_size),
+    policy_table(policy_table),
+    common_random_numbers(common_random_numbers),
+    leaf_evaluator(frame),
+    leaf_evaluator_enabled(leaf_evaluator_enabled),
+    orig_num_ships_in_cell(board_size),
+    orig_num_own_ships_in_cell(num_players*board_size),
+    halite(board_size*LANE_WIDTH),
+    num_ships_in_cell(board_size*LANE_WIDTH),
+    num_own_ships_in_cell(num_players*board_size*LANE_WIDTH),
+    inspiration_enabled(inspiration_enabled),
+    inspiration(width, height, num_players, LANE_WIDTH),
+    ship_position(ships.size()*LANE_WIDTH),
+    ship_halite(ships.size()*LANE_WIDTH),
+    ship_turns_underway(ships.size()*LANE_WIDTH),
+    ship_halite_per_turn(ships.size()*LANE_WIDTH),
+    ship_destroyed(ships.size()*LANE_WIDTH),
+    planned_moves_taken(ships.size()*LANE_WIDTH),
+    neighbors(board_size*ALL_DIRECTIONS.size()),
+    is_dirty(board_size*LANE_WIDTH),
+    num_ship_steps(0)
+{
+    auto& game_map = frame.get_game().game_map;
+    // Initialize halite
+    for (int y=0; y < height; y++) {
+        for (int x=0; x < width; x++) {
+            hlt::Position pos(x, y);
+            auto idx = frame.get_index(pos);
+            original_halite[idx] = game_map->at(pos)->halite;
+        }
+    }
+
+    // Initialize distance_to_dropoff
+    for (auto player : frame.get_game().players) {
+        std::vector<int> distances(board_size);
+        for (int y=0; y < height; y++) {
+            for (int x=0; x < width; x++) {
+                int shipyard_dist = game_map->calculate_distance(
+                    hlt::Position(x, y),
+                    player->shipyard->position
+                );
+                distances[y*width+x] = shipyard_dist;
+            }
+        }
+        distance_to_dropoff.push_back(distances);
+    }
+
+    // Initialize num_ships_in_cell
+    for (auto& ship : ships) {
+        orig_num_own_ships_in_cell[ship.player*board_size+ship.position] = 1;
+        orig_num_ships_in_cell[ship.position] = 1;
+    }
+
+    // Initialize inspiration
+    if (inspiration_enabled) {
+        for (auto& ship : ships) {
+            inspiration.add_ship(ship.position, ship.player);
+        }
+    }
+
+    for (int position=0; position < board_size; position++) {
+        for (size_t move=0; move < ALL_DIRECTIONS.size(); move++) {
+            neighbors[position*ALL_DIRECTIONS.size()+move] = move_position(position, move);
+        }
+    }
+
+    for (int lane=0; lane < LANE_WIDTH; lane++) {
+        lane_generators.push_back(generator.split());
+    }
+
+    // Enough that pushing never allocates.
+    dirty_cells.reserve(board_size*LANE_WIDTH);
+    // The rollout state starts out as the original state in every lane.
+    for (int position=0; position < board_size; position++) {
+        for (int lane=0; lane < LANE_WIDTH; lane++) {
+            touch(position, lane);
+        }
+    }
+    reset();
+}
+
+void MctsSimulation::reset() {
+    for (auto idx : dirty_cells) {
+        int position = idx/LANE_WIDTH;
+        halite[idx] = original_halite[position];
+        num_ships_in_cell[idx] = orig_num_ships_in_cell[position];
+        for (int player=0; player < num_players; player++) {
+            int orig_idx = player*board_size+position;
+            num_own_ships_in_cell[player*board_size*LANE_WIDTH+idx] =
+                orig_num_own_ships_in_cell[orig_idx];
+        }
+        is_dirty[idx] = false;
+    }
+    dirty_cells.clear();
+    inspiration.reset();
+
+    for (size_t ship_idx=0; ship_idx < original_ships.size(); ship_idx++) {
+        auto& ship = original_ships[ship_idx];
+        for (int lane=0; lane < LANE_WIDTH; lane++) {
+            int idx = ship_idx*LANE_WIDTH+lane;
+            ship_position[idx] = ship.position;
+            ship_halite[idx] = ship.halite;
+            ship_turns_underway[idx] = ship.turns_underway;
+            ship_halite_per_turn[idx] = ship.halite_per_turn;
+            ship_destroyed[idx] = ship.destroyed;
+        }
+    }
+    std::fill(planned_moves_taken.begin(), planned_moves_taken.end(), 0);
+}
+
+int MctsSimulation::move_position(int position, int move) const {
+    switch (move) {
+        case STILL_INDEX: return position;
+        case NORTH_INDEX: return pos_mod(position-width, width*height);
+        case SOUTH_INDEX: return (position+width)%(width*height);
+        case EAST_INDEX:
+            if (position%width == width-1) {
+                return position - (width-1);
+            } else {
+                return position + 1;
+            }
+        case WEST_INDEX:
+            if (position%width == 0) {
+                return position + (width-1);
+            } else {
+                return position - 1;
+            }
+        default: return position;
+    }
+}
+
+int MctsSimulation::count_unfinished(int num_lanes) const {
+    int num_unfinished = 0;
+    for (size_t ship_idx=0; ship_idx < original_ships.size(); ship_idx++) {
+        for (int lane=0; lane < num_lanes; lane++) {
+            int idx = ship_idx*LANE_WIDTH+lane;
+            if (!ship_destroyed[idx] && ship_halite_per_turn[idx] < 0) { num_unfinished++; }
+        }
+    }
+    return num_unfinished;
+}
+
+void MctsSimulation::copy_first_lane(int num_lanes) {
+    // The other lanes have not changed since the reset, so only the changed cells are copied.
+    size_t num_dirty_cells = dirty_cells.size();
+    for (size_t dirty_idx=0; dirty_idx < num_dirty_cells; dirty_idx++) {
+        int idx = dirty_cells[dirty_idx];
+        if (idx%LANE_WIDTH != 0) { continue; }
+        int position = idx/LANE_WIDTH;
+        for (int lane=1; lane < num_lanes; lane++) {
+            halite[idx+lane] = halite[idx];
+            num_ships_in_cell[idx+lane] = num_ships_in_cell[idx];
+            for (int player=0; player < num_players; player++) {
+                int player_idx = player*board_size*LANE_WIDTH+idx;
+                num_own_ships_in_cell[player_idx+lane] = num_own_ships_in_cell[player_idx];
+            }
+            touch(position, lane);
+        }
+    }
+    if (inspiration_enabled) {
+        for (int lane=1; lane < num_lanes; lane++) {
+            inspiration.copy_lane(0, lane);
+        }
+    }
+
+    for (size_t ship_idx=0; ship_idx < original_ships.size(); ship_idx++) {
+        int idx = ship_idx*LANE_WIDTH;
+        for (int lane=1; lane < num_lanes; lane++) {
+            ship_position[idx+lane] = ship_position[idx];
+            ship_halite[idx+lane] = ship_halite[idx];
+            ship_turns_underway[idx+lane] = ship_turns_underway[idx];
+            ship_halite_per_turn[idx+lane] = ship_halite_per_turn[idx];
+            ship_destroyed[idx+lane] = ship_destroyed[idx];
+            planned_moves_taken[idx+lane] = planned_moves_taken[idx];
+        }
+    }
+}
+
+int MctsSimulation::run(const ShipMoves& moves, int max_depth, std::vector<float>& res) {
+    return simulate(moves, max_depth, 1, false, res);
+}
+
+int MctsSimulation::run_batch(const ShipMoves& moves, int max_depth, std::vector<float>& res) {
+    return simulate(moves, max_depth, NUM_LANES, true, res);
+}
+
+int MctsSimulation::get_num_ship_steps() const {
+    return num_ship_steps;
+}
+
+int MctsSimulation::simulate(
+    const ShipMoves& moves,
+    int max_depth,
+    int num_lanes,
+    bool use_lane_moves,
+    std::vector<float>& res
+) {
+    reset();
+    num_ship_steps = 0;
+
+    int num_ships = original_ships.size();
+    max_depth = std::min(turns_left, max_depth);
+
+    // Exact for any amount of halite that fits in a float, so the results are the same as with
+    // integer division, which can not be vectorized.
+    float move_cost_ratio = hlt::constants::MOVE_COST_RATIO;
+    float extract_ratio = hlt::constants::EXTRACT_RATIO;
+    // Inspired ships get the bonus on top of the mined halite.
+    float inspired_bonus = 1+hlt::constants::INSPIRED_BONUS_MULTIPLIER;
+    int max_halite = hlt::constants::MAX_HALITE;
+
+    // Numbers shared by all lanes are derived from this, the ship and the turn.
+    uint64_t common_seed = common_random_numbers ? lane_generators[0]() : 0;
+
+    // The lanes only differ in the moves that the active ships take after their given moves, so
+    // only the first lane is simulated until then, and copied to the others. The other ships,
+    // including frozen ones after their single move, follow the policy with the random numbers of
+    // the first lane in the meantime.
+    int shared_depth = 0;
+    if (num_lanes > 1) {
+        shared_depth = MAX_DEPTH;
+        bool has_lane_moves = false;
+        for (int ship_idx=0; ship_idx < num_ships; ship_idx++) {
+            if (!moves.is_active(ship_idx) || moves.is_frozen(ship_idx)) { continue; }
+            has_lane_moves = true;
+            shared_depth = std::min(shared_depth, moves.get_path_size(ship_idx));
+        }
+        // Otherwise the lanes only differ in their random numbers.
+        if (!has_lane_moves) { shared_depth = 0; }
+    }
+    int active_lanes = (shared_depth > 0) ? 1 : num_lanes;
+
+    // The score of a ship is final once it has reached a dropoff or is destroyed, after which the
+    // rollout can be stopped.
+    int num_unfinished = count_unfinished(active_lanes);
+
+    // Simulation
+    int depth = 0;
+    for (; depth < max_depth; depth++) {
+        if (active_lanes < num_lanes && (depth == shared_depth || num_unfinished == 0)) {
+            copy_first_lane(num_lanes);
+            active_lanes = num_lanes;
+            num_unfinished = count_unfinished(active_lanes);
+        }
+        if (num_unfinished == 0) { break; }
+
+        // Update ships and halite
+        for (int ship_idx=0; ship_idx < num_ships; ship_idx++) {
+            int player = original_ships[ship_idx].player;
+            int* position = &ship_position[ship_idx*LANE_WIDTH];
+            hlt::Halite* current_halite = &ship_halite[ship_idx*LANE_WIDTH];
+            int path_size = moves.get_path_size(ship_idx);
+            int lane_path_size = path_size;
+            if (use_lane_moves && moves.is_active(ship_idx) && !moves.is_frozen(ship_idx)) {
+                lane_path_size++;
+            }
+
+            // The values of the lanes, where padding and destroyed ships are left at 0.
+            bool is_running[LANE_WIDTH] = {};
+            int lane_moves[LANE_WIDTH] = {};
+            int cell_halite[LANE_WIDTH] = {};
+            int is_inspired[LANE_WIDTH] = {};
+            for (int lane=0; lane < active_lanes; lane++) {
+                if (ship_destroyed[ship_idx*LANE_WIDTH+lane]) { continue; }
+                is_running[lane] = true;
+                num_ship_steps++;
+                cell_halite[lane] = halite[position[lane]*LANE_WIDTH+lane];
+
+                int move;
+                int& planned_moves = planned_moves_taken[ship_idx*LANE_WIDTH+lane];
+                if (planned_moves < lane_path_size) {
+                    // Past the given moves, the move of the lane is taken.
+                    move = lane;
+                    if (planned_moves < path_size) {
+                        move = moves.get_move(ship_idx, planned_moves);
+                    }
+                    int neighbor = get_neighbor(position[lane], move);
+                    // Only avoid own ships in searched nodes.
+                    // Opponents might not be as nice as we are.
+                    int num_own_ships =
+                        num_own_ships_in_cell[(player*board_size+neighbor)*LANE_WIDTH+lane];
+                    if (move != STILL_INDEX && num_own_ships != 0) {
+                        move = STILL_INDEX;
+                    } else {
+                        planned_moves++;
+                    }
+                } else {
+                    uint32_t random = common_random_numbers
+                        ? Rng::mix(common_seed+(depth*num_ships+ship_idx)*0x9e3779b97f4a7c15) >> 32
+                        : lane_generators[lane]() >> 32;
+                    if (policy_table.should_mine(cell_halite[lane], random)) {
+                        move = STILL_INDEX;
+                    } else {
+                        // avoid collisions
+                        bool possible_moves[4];
+                        // Avoid all collisions when using default policy
+                        // Collisions can be avoided anyway, so should not fear going closer
+                        for (size_t move=1; move < ALL_DIRECTIONS.size(); move++) {
+                            int neighbor = get_neighbor(position[lane], move);
+                            possible_moves[move-1] =
+                                (num_ships_in_cell[neighbor*LANE_WIDTH+lane] == 0);
+                        }
+                        move = policy_table.get_move(
+                            player, position[lane], current_halite[lane], possible_moves, random);
+                    }
+                }
+                lane_moves[lane] = move;
+            }
+
+            // Mining and moving costs for all lanes at once, so these loops have no branches.
+            int move_costs[LANE_WIDTH];
+            int is_still[LANE_WIDTH];
+            for (int lane=0; lane < LANE_WIDTH; lane++) {
+                move_costs[lane] = cell_halite[lane]/move_cost_ratio;
+                // Not possible to move
+                is_still[lane] =
+                    (lane_moves[lane] == STILL_INDEX) | (move_costs[lane] > current_halite[lane]);
+            }
+
+            // Only needed for the ships that mine.
+            if (inspiration_enabled) {
+                for (int lane=0; lane < active_lanes; lane++) {
+                    if (is_running[lane] && is_still[lane]) {
+                        is_inspired[lane] = inspiration.is_inspired(position[lane], player, lane);
+                    }
+                }
+            }
+
+            int new_ship_halite[LANE_WIDTH];
+            int new_cell_halite[LANE_WIDTH];
+            for (int lane=0; lane < LANE_WIDTH; lane++) {
+                // Both results are computed and selected between, since a conditional float
+                // operation is a branch.
+                int max_mined = (cell_halite[lane]+extract_ratio-1)/extract_ratio;
+                int inspired_mined = max_mined*inspired_bonus;
+                max_mined = is_inspired[lane] ? inspired_mined : max_mined;
+
+                int mined_halite = std::min(max_halite, current_halite[lane]+max_mined);
+                int removed_halite = mined_halite-current_halite[lane];
+                int inspired_removed = removed_halite/inspired_bonus;
+                removed_halite = is_inspired[lane] ? inspired_removed : removed_halite;
+
+                new_ship_halite[lane] =
+                    is_still[lane] ? mined_halite : current_halite[lane]-move_costs[lane];
+                new_cell_halite[lane] =
+                    is_still[lane] ? cell_halite[lane]-removed_halite : cell_halite[lane];
+            }
+
+            for (int lane=0; lane < active_lanes; lane++) {
+                if (!is_running[lane]) { continue; }
+                int idx = ship_idx*LANE_WIDTH+lane;
+                current_halite[lane] = new_ship_halite[lane];
+                if (is_still[lane]) {
+                    // Mining
+                    halite[position[lane]*LANE_WIDTH+lane] = new_cell_halite[lane];
+                    touch(position[lane], lane);
+                } else {
+                    // Moving
+                    num_ships_in_cell[position[lane]*LANE_WIDTH+lane]--;
+                    num_own_ships_in_cell[(player*board_size+position[lane])*LANE_WIDTH+lane]--;
+                    touch(position[lane], lane);
+                    int previous_position = position[lane];
+                    position[lane] = get_neighbor(position[lane], lane_moves[lane]);
+                    num_ships_in_cell[position[lane]*LANE_WIDTH+lane]++;
+                    num_own_ships_in_cell[(player*board_size+position[lane])*LANE_WIDTH+lane]++;
+                    touch(position[lane], lane);
+                    if (inspiration_enabled) {
+                        int num_remaining = num_own_ships_in_cell[
+                            (player*board_size+previous_position)*LANE_WIDTH+lane];
+                        inspiration.set_occupied(
+                            previous_position, player, lane, num_remaining > 0);
+                        inspiration.set_occupied(position[lane], player, lane, true);
+                    }
+                }
+                ship_turns_underway[idx]++;
+                if (get_distance_to_dropoff(position[lane], player) == 0
+                    && ship_halite_per_turn[idx] < 0
+                ) {
+                    ship_halite_per_turn[idx] =
+                        ((float)current_halite[lane])/ship_turns_underway[idx];
+                    num_unfinished--;
+                }
+            }
+        }
+
+        for (int lane=0; lane < active_lanes; lane++) {
+            // Destroy ships
+            for (int ship_idx=0; ship_idx < num_ships; ship_idx++) {
+                int idx = ship_idx*LANE_WIDTH+lane;
+                int position = ship_position[idx];
+                if (num_ships_in_cell[position*LANE_WIDTH+lane] > 1) {
+                    int player = original_ships[ship_idx].player;
+                    if (inspiration_enabled) {
+                        inspiration.set_occupied(position, player, lane, false);
+                    }
+                    if (!ship_destroyed[idx] && ship_halite_per_turn[idx] < 0) {
+                        num_unfinished--;
+                    }
+                    ship_destroyed[idx] = true;
+                    ship_halite[idx] = 0;
+                    num_own_ships_in_cell[(player*board_size+position)*LANE_WIDTH+lane] = 0;
+                    touch(position, lane);
+                }
+            }
+            for (int ship_idx=0; ship_idx < num_ships; ship_idx++) {
+                int position = ship_position[ship_idx*LANE_WIDTH+lane];
+                if (num_ships_in_cell[position*LANE_WIDTH+lane] > 1) {
+                    num_ships_in_cell[position*LANE_WIDTH+lane] = 0;
+                }
+            }
+        }
+    }
+    if (active_lanes < num_lanes) {
+        copy_first_lane(num_lanes);
+    }
+
+    res.resize(num_lanes*num_ships);
+    for (int lane=0; lane < num_lanes; lane++) {
+        for (int ship_idx=0; ship_idx < num_ships; ship_idx++) {
+            int idx = ship_idx*LANE_WIDTH+lane;
+            float& ship_res = res[lane*num_ships+ship_idx];
+            // The halite of a ship that reached a dropoff was delivered, even if the ship is
+            // destroyed afterwards.
+            if (ship_halite_per_turn[idx] >= 0) {
+                ship_res = ship_halite_per_turn[idx];
+            } else if (ship_destroyed[idx]) {
+                ship_res = 0.0;
+            } else if (leaf_evaluator_enabled) {
+                int player = original_ships[ship_idx].player;
+                ship_res = leaf_evaluator.evaluate(
+                    ship_position[idx],
+                    ship_halite[idx],
+                    ship_turns_underway[idx],
+                    get_distance_to_dropoff(ship_position[idx], player),
+                    turns_left-depth);
+            } else {
+                // An estimate of turns needed to reach a dropoff, assuming each cell has
+                // an equal, non-zero amount of halite
+                float turns_spent_mining =
+                    ((float)hlt::constants::EXTRACT_RATIO)/hlt::constants::MOVE_COST_RATIO;
+                float remaining_turns = get_distance_to_dropoff(
+                    ship_position[idx], original_ships[ship_idx].player)*(1.0+turns_spent_mining);
+                if (depth+remaining_turns <= turns_left) {
+                    ship_res = ((float)ship_halite[idx])/(ship_turns_underway[idx]+remaining_turns);
+                } else {
+                    // Not making it before the end of the game.
+                    ship_res = 0.0;
+                }
+            }
+        }
+    }
+
+#ifdef DEBUG
+    std::cerr << "simulation" << std::endl;
+    std::cerr << moves << std::endl;
+    for (int lane=0; lane < num_lanes; lane++) {
+        std::cerr << "lane " << lane << ":";
+        for (int ship_idx=0; ship_idx < num_ships; ship_idx++) {
+            std::cerr << " " << res[lane*num_ships+ship_idx];
+        }
+        std::cerr << std::endl;
+    }
+#endif
+
+    return depth;
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include "bot/frame.hpp"
+#include "bot/gravity_grid.hpp"
+#include "bot/inspiration.hpp"
+#include "bot/mcts_tree.hpp"
+#include "bot/random.hpp"
+#include "hlt/constants.hpp"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+struct SimulatedShip {
+    int position;
+    hlt::Halite halite;
+    int turns_underway;
+    // Set to -1 if the dropoff has not been reached yet.
+    float halite_per_turn;
+    bool destroyed;
+    hlt::PlayerId player;
+
+    SimulatedShip(int position, hlt::Halite halite, int turns_underway, hlt::PlayerId player)
+      : position(position),
+        halite(halite),
+        turns_underway(turns_underway),
+        halite_per_turn(-1),
+        destroyed(false),
+        player(player)
+    {
+    }
+};
+
+struct RandomPolicy {
+    int get_move(Rng& generator) {
+        // distribution is inclusive
+        std::uniform_int_distribution<int> distribution(1, ALL_DIRECTIONS.size()-1);
+        return distribution(generator);
+    }
+};
+
+struct GravityPolicy {
+    GravityGrid& mining_grid;
+    GravityGrid& return_grid;
+
+    GravityPolicy(GravityGrid& mining_grid, GravityGrid& return_grid)
+      : mining_grid(mining_grid),
+        return_grid(return_grid)
+    {
+    }
+
+    float get_move_weight(int move, int position, hlt::Halite current_halite) {
+        float pull_fraction =
+            ((float)hlt::constants::MAX_HALITE-current_halite)/hlt::constants::MAX_HALITE;
+        float return_fraction = 1.0-pull_fraction;
+        float res = 0;
+        res += pull_fraction*mining_grid.get_pull(position, move);
+        res += return_fraction*return_grid.get_pull(position, move);
+        return res;
+    }
+};
+
+// Wrapper around other policies that allows removing moves
+// This is useful for avoiding collisions in rollouts.
+struct MovePolicy {
+    GravityPolicy policy;
+
+    MovePolicy(GravityPolicy policy)
+      : policy(policy)
+    {
+    }
+
+    int get_move(Rng& rng, int position, hlt::Halite current_halite, bool allowed_moves[4]) {
+        float weights[4];
+        for (size_t move=1; move < ALL_DIRECTIONS.size(); move++) {
+            if (allowed_moves[move-1]) {
+                weights[move-1] = policy.get_move_weight(move, position, current_halite);
+            } else {
+                weights[move-1] = 0;
+            }
+        }
+
+        float sum_weights = 0;
+        for (auto w : weights) { sum_weights += w; }
+        if (sum_weights == 0) { return 0; }
+
+        float rand = std::uniform_real_distribution<float>()(rng);
+        float move_treshold = 0;
+        for (size_t move = 1; move < ALL_DIRECTIONS.size(); move++) {
+            move_treshold += weights[move-1]/sum_weights;
+            if (rand < move_treshold) { return move; }
+        }
+        return 0;
+    }
+};
+
+struct MiningPolicy {
+    int map_size;
+
+    MiningPolicy(int map_size)
+      : map_size(map_size)
+    {
+    }
+
+    // Probability of mining.
+    float get_treshold(hlt::Halite halite_at_position, hlt::Halite total_halite) const {
+        float average_halite = ((float)total_halite)/map_size;
+        return halite_at_position/(2*average_halite);
+    }
+
+    bool should_mine(Rng& generator, hlt::Halite halite_at_position, hlt::Halite total_halite) {
+        float treshold = get_treshold(halite_at_position, total_halite);
+        float rand = std::uniform_real_distribution<float>()(generator);
+        return rand < treshold;
+    }
+};
+
+// Number of ranges of ship halite for which PolicyTable stores the move weights.
+const int NUM_HALITE_BUCKETS = 8;
+// Share of the uniform distribution in the priors of PolicyTable::get_priors.
+const float PRIOR_UNIFORM_SHARE = 0.1;
+
+// The MovePolicy and MiningPolicy of all players, precomputed for a frame, so that a rollout step
+// is a few table lookups.
+//
+// The move weights are computed at the middle of each range of ship halite, and quantized so that
+// the weights of a cell sum to 1 << 15. The mining tresholds are stored for each amount of cell
+// halite up to the maximum on the map, since cells only lose halite during rollouts.
+//
+// Both decisions take their randomness from a single 32 bit number: the upper half decides
+// whether to mine, and the lower half picks the move.
+class PolicyTable {
+    int board_size;
+    // Indexed by ((player*board_size+position)*NUM_HALITE_BUCKETS+bucket)*4+move-1, so that all
+    // weights of a cell share a cache line.
+    std::vector<uint16_t> move_weights;
+    // Out of 1 << 16, indexed by cell halite.
+    std::vector<uint32_t> mining_tresholds;
+
+public:
+    PolicyTable(const Frame& frame, const std::vector<MovePolicy>& move_policies);
+
+    bool should_mine(hlt::Halite halite_at_position, uint32_t random) const {
+        return (random >> 16) < mining_tresholds[halite_at_position];
+    }
+
+    // The probability of each move of the rollout policy, when none is blocked. Each move keeps
+    // PRIOR_UNIFORM_SHARE of a uniform distribution, so that no move is left out of a search.
+    void get_priors(
+        int player,
+        int position,
+        hlt::Halite current_halite,
+        hlt::Halite cell_halite,
+        float priors[5]
+    ) const;
+
+    // Same as MovePolicy::get_move, returning STILL_INDEX if no allowed move has any weight.
+    int get_move(
+        int player,
+        int position,
+        hlt::Halite current_halite,
+        const bool allowed_moves[4],
+        uint32_t random
+    ) const {
+        int bucket = std::min(
+            NUM_HALITE_BUCKETS-1, current_halite*NUM_HALITE_BUCKETS/hlt::constants::MAX_HALITE);
+        const uint16_t* weights =
+            &move_weights[((player*board_size+position)*NUM_HALITE_BUCKETS+bucket)*4];
+        uint32_t allowed_weights[4];
+        uint32_t sum_weights = 0;
+        for (int move=0; move < 4; move++) {
+            allowed_weights[move] = allowed_moves[move] ? weights[move] : 0;
+            sum_weights += allowed_weights[move];
+        }
+        if (sum_weights == 0) { return STILL_INDEX; }
+
+        uint32_t treshold = ((random & 0xffff)*sum_weights) >> 16;
+        for (int move=0; move < 4; move++) {
+            if (treshold < allowed_weights[move]) { return move+1; }
+            treshold -= allowed_weights[move];
+        }
+        // Not reached, as the treshold is below the sum of the weights.
+        return STILL_INDEX;
+    }
+};
+
+// Radius of the area around a ship whose halite LeafEvaluator expects it to mine.
+const int LEAF_MINING_RADIUS = 2;
+
+// Estimates the halite per turn that a ship will deliver, for rollouts that end before the ship
+// has reached a dropoff. The ship either returns right away, or first fills up by mining the area
+// around it at the rate of its average halite. Both take the move costs of that area.
+class LeafEvaluator {
+    // Average halite within LEAF_MINING_RADIUS of each position.
+    std::vector<float> area_halite;
+
+public:
+    LeafEvaluator(const Frame& frame);
+
+    // turns_left is the number of turns the ship has left after the rollout.
+    float evaluate(
+        int position,
+        hlt::Halite halite,
+        int turns_underway,
+        int distance_to_dropoff,
+        int turns_left
+    ) const;
+};
+
+// Number of rollouts that run_batch simulates together, one for each move of the ships.
+const int NUM_LANES = 5;
+// Stride between the values of the lanes. Padded to a multiple of the vector width, so that
+// arithmetic over all lanes compiles to whole vector instructions.
+const int LANE_WIDTH = 8;
+
+// Simulates the game from the current frame using the moves in the search trees, and a random
+// policy for the remaining moves.
+//
+// Several rollouts, called lanes, can be run in lockstep. The state of each value is stored for
+// all lanes next to each other, indexed by idx*LANE_WIDTH+lane.
+//
+// The state of a rollout is kept between runs, and is reset by restoring only the cells that were
+// changed, so that running a simulation does not allocate or copy the whole board.
+//
+// The frame is only read by the constructor, so a simulation can keep running while the game is
+// updated.
+class MctsSimulation {
+    // Turns left in the game at the frame.
+    int turns_left;
+    int width;
+    int height;
+    int board_size;
+    int num_players;
+
+    std::vector<SimulatedShip> original_ships;
+    std::vector<hlt::Halite> original_halite;
+
+    const PolicyTable& policy_table;
+    // Each lane draws from its own stream.
+    std::vector<Rng> lane_generators;
+    // Whether all lanes use the same random number for the same ship and turn, so that the
+    // differences between lanes come from their moves rather than from chance.
+    bool common_random_numbers;
+
+    // The distances to each dropoff from each position for each player
+    std::vector<std::vector<int>> distance_to_dropoff;
+    LeafEvaluator leaf_evaluator;
+    // Whether ships that have not reached a dropoff are scored by leaf_evaluator.
+    bool leaf_evaluator_enabled;
+
+    // Precalculated values
+    std::vector<int> orig_num_ships_in_cell;
+    // Indexed by player*board_size+position.
+    std::vector<int> orig_num_own_ships_in_cell;
+
+    // State of the current rollouts, with the same layout as the original values for each lane.
+    std::vector<hlt::Halite> halite;
+    std::vector<int> num_ships_in_cell;
+    std::vector<int> num_own_ships_in_cell;
+    // Whether ships are inspired. If not, the inspiration counts are not updated.
+    bool inspiration_enabled;
+    InspirationTracker inspiration;
+    // State of the ships, indexed by ship_idx*LANE_WIDTH+lane.
+    std::vector<int> ship_position;
+    std::vector<hlt::Halite> ship_halite;
+    std::vector<int> ship_turns_underway;
+    std::vector<float> ship_halite_per_turn;
+    std::vector<char> ship_destroyed;
+    // Number of moves used from the given moves. Usually will be equal to depth,
+    // but might not be in the case that a ship has been delayed due to collision avoidance.
+    std::vector<int> planned_moves_taken;
+
+    // The position reached by each move from each position, indexed by position*5+move.
+    std::vector<int> neighbors;
+
+    // Cells of a lane which have been changed since the last reset, as position*LANE_WIDTH+lane.
+    std::vector<int> dirty_cells;
+    std::vector<char> is_dirty;
+
+    // Number of turns simulated for a ship in a lane by the last run.
+    int num_ship_steps;
+
+public:
+    MctsSimulation(
+        Rng& generator,
+        const Frame& frame,
+        std::vector<SimulatedShip> ships,
+        const PolicyTable& policy_table,
+        bool inspiration_enabled,
+        bool common_random_numbers=false,
+        bool leaf_evaluator_enabled=false
+    );
+
+    // Simulate the moves, and store the score of each ship in res.
+    // res is resized to the number of ships.
+    // Returns the number of simulated turns, which is less than max_depth if the scores of all
+    // ships were final before that.
+    int run(const ShipMoves& moves, int max_depth, std::vector<float>& res);
+
+    // Simulate the moves once for each lane, where each active ship takes the move with the index
+    // of the lane after its given moves, as with ShipMoves::push_temp.
+    // res is resized to NUM_LANES*number of ships, and indexed by lane*number of ships+ship_idx.
+    int run_batch(const ShipMoves& moves, int max_depth, std::vector<float>& res);
+
+    // Number of turns simulated for a ship in a lane by the last run, over all ships and lanes.
+    // Destroyed ships, and lanes before they are copied from the first one, do not count.
+    int get_num_ship_steps() const;
+
+private:
+    int simulate(
+        const ShipMoves& moves,
+        int max_depth,
+        int num_lanes,
+        bool use_lane_moves,
+        std::vector<float>& res);
+    // Restore the state of the current frame.
+    void reset();
+    // Number of ships of the lanes whose score can still change.
+    int count_unfinished(int num_lanes) const;
+    // Copy the state of the first lane to the other lanes, which must not have changed since the
+    // last reset.
+    void copy_first_lane(int num_lanes);
+    // Mark a position of a lane as changed, so that it is restored by the next reset.
+    void touch(int position, int lane) {
+        int idx = position*LANE_WIDTH+lane;
+        if (!is_dirty[idx]) {
+            is_dirty[idx] = true;
+            dirty_cells.push_back(idx);
+        }
+    }
+
+    int move_position(int position, int move) const;
+    int get_neighbor(int position, int move) const {
+        return neighbors[position*ALL_DIRECTIONS.size()+move];
+    }
+    int get_distance_to_dropoff(int pos, int player) const {
+        return distance_to_dropoff[player][pos];
+    }
+};
@@ -0,0 +1,602 @@
+#include "bot/math.hpp"
+#include "bot/mcts_simulation.hpp"
+#include "bot/mcts_tree.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+
+std::ostream& operator<<(std::ostream& os, const ShipMoves& moves) {
+    os << "{";
+    for (int ship_idx=0; ship_idx < moves.num_ships; ship_idx++) {
+        os << (ship_idx == 0 ? " " : ", ") << "[";
+        for (int depth=0; moves.is_move_specified(ship_idx, depth); depth++) {
+            os << (depth == 0 ? " " : ", ");
+            os << moves.get_move(ship_idx, depth);
+        }
+        os << " ]";
+    }
+    os << " }";
+    return os;
+}
+
+float MctsNode::get_average_reward() const {
+    float points = reward_points.load(std::memory_order_relaxed);
+    return points/(WIN_POINTS*visits.load(std::memory_order_relaxed));
+}
+
+float MctsNode::get_amaf_reward() const {
+    float points = amaf_reward_points.load(std::memory_order_relaxed);
+    return points/(WIN_POINTS*amaf_visits.load(std::memory_order_relaxed));
+}
+
+MctsNodePool::MctsNodePool(int capacity)
+  : nodes(capacity),
+    size(0)
+{
+}
+
+void MctsNodePool::clear() {
+    size.store(0, std::memory_order_relaxed);
+}
+
+NodeIndex MctsNodePool::allocate(int num_nodes) {
+    // Check first so that size does not keep growing once the pool is full.
+    if (size.load(std::memory_order_relaxed)+num_nodes > (int)nodes.size()) { return NO_NODE; }
+    NodeIndex first = size.fetch_add(num_nodes, std::memory_order_relaxed);
+    if (first+num_nodes > (int)nodes.size()) { return NO_NODE; }
+
+    for (NodeIndex idx=first; idx < first+num_nodes; idx++) {
+        nodes[idx].visits.store(0, std::memory_order_relaxed);
+        nodes[idx].reward_points.store(0, std::memory_order_relaxed);
+        nodes[idx].first_child.store(LEAF, std::memory_order_relaxed);
+        nodes[idx].prior = 1.0/ALL_DIRECTIONS.size();
+        nodes[idx].amaf_visits.store(0, std::memory_order_relaxed);
+        nodes[idx].amaf_reward_points.store(0, std::memory_order_relaxed);
+    }
+    return first;
+}
+
+void MctsNodePool::expand(NodeIndex node_idx, const float* priors) {
+    auto& node = nodes[node_idx];
+    NodeIndex expected = LEAF;
+    if (!node.first_child.compare_exchange_strong(expected, EXPANDING, std::memory_order_acquire)) {
+        return;
+    }
+    NodeIndex first_child = allocate(ALL_DIRECTIONS.size());
+    if (first_child != NO_NODE && priors != nullptr) {
+        for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+            nodes[first_child+child_idx].prior = priors[child_idx];
+        }
+    }
+    // Publishes the initialized children to other threads.
+    node.first_child.store(first_child == NO_NODE ? LEAF : first_child, std::memory_order_release);
+}
+
+NodeIndex MctsNodePool::get_child(NodeIndex node_idx, int move) const {
+    NodeIndex first_child = nodes[node_idx].first_child.load(std::memory_order_acquire);
+    return first_child < 0 ? NO_NODE : first_child+move;
+}
+
+void copy_statistics(const MctsNode& source, MctsNode& target) {
+    target.visits.store(source.visits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    target.reward_points.store(
+        source.reward_points.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    target.prior = source.prior;
+    target.amaf_visits.store(
+        source.amaf_visits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    target.amaf_reward_points.store(
+        source.amaf_reward_points.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+NodeIndex MctsNodePool::copy_subtree(
+    const MctsNodePool& source,
+    NodeIndex source_root,
+    int max_nodes
+) {
+    NodeIndex root = allocate(1);
+    if (root == NO_NODE) { return NO_NODE; }
+    copy_statistics(source[source_root], nodes[root]);
+    if (copied_children.size() < source.nodes.size()) {
+        copied_children.resize(source.nodes.size(), NO_NODE);
+    }
+
+    // Breadth first, so that the upper levels of the tree are kept close together and survive
+    // if the pool runs full.
+    copy_queue.clear();
+    copy_queue.push_back({ source_root, root });
+    int num_copied = 1;
+    for (size_t queue_idx=0; queue_idx < copy_queue.size(); queue_idx++) {
+        NodeIndex source_first_child = source[copy_queue[queue_idx].first].first_child;
+        NodeIndex target = copy_queue[queue_idx].second;
+        if (source_first_child < 0) { continue; }
+
+        // Children shared by several nodes stay shared.
+        if (copied_children[source_first_child] != NO_NODE) {
+            nodes[target].first_child.store(
+                copied_children[source_first_child], std::memory_order_relaxed);
+            continue;
+        }
+        if (num_copied+(int)ALL_DIRECTIONS.size() > max_nodes) { break; }
+        NodeIndex first_child = allocate(ALL_DIRECTIONS.size());
+        if (first_child == NO_NODE) { break; }
+        num_copied += ALL_DIRECTIONS.size();
+        for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+            copy_statistics(source[source_first_child+child_idx], nodes[first_child+child_idx]);
+            copy_queue.push_back({ source_first_child+child_idx, first_child+child_idx });
+        }
+        nodes[target].first_child.store(first_child, std::memory_order_relaxed);
+        copied_children[source_first_child] = first_child;
+    }
+
+    // Only the children of queued nodes can have been marked.
+    for (auto& source_target : copy_queue) {
+        NodeIndex source_first_child = source[source_target.first].first_child;
+        if (source_first_child >= 0) { copied_children[source_first_child] = NO_NODE; }
+    }
+    return root;
+}
+
+int MctsNodePool::get_size() const {
+    return std::min((int)nodes.size(), size.load(std::memory_order_relaxed));
+}
+
+int MctsNodePool::get_capacity() const {
+    return nodes.size();
+}
+
+TranspositionTable::TranspositionTable(int capacity)
+  : entries(1 << (int)std::ceil(std::log2(std::max(capacity, 1))))
+{
+}
+
+void TranspositionTable::reset() {
+    for (auto& entry : entries) {
+        entry.key.store(0, std::memory_order_relaxed);
+        entry.node.store(NO_NODE, std::memory_order_relaxed);
+    }
+}
+
+void PathModel::reset(const Frame& frame) {
+    auto& game_map = *frame.get_game().game_map;
+    int board_size = game_map.width*game_map.height;
+    neighbors.resize(board_size*ALL_DIRECTIONS.size());
+    original_halite.resize(board_size);
+    for (int y=0; y < game_map.height; y++) {
+        for (int x=0; x < game_map.width; x++) {
+            hlt::Position pos(x, y);
+            int position = frame.get_index(pos);
+            original_halite[position] = game_map.at(pos)->halite;
+            for (size_t move=0; move < ALL_DIRECTIONS.size(); move++) {
+                neighbors[position*ALL_DIRECTIONS.size()+move] =
+                    frame.get_index(frame.move(pos, ALL_DIRECTIONS[move]));
+            }
+        }
+    }
+}
+
+PathState PathModel::get_start_state(int position, hlt::Halite halite) const {
+    return { 0, position, halite, original_halite[position] };
+}
+
+void PathModel::step(PathState& state, int move) const {
+    state.depth++;
+    hlt::Halite move_cost = state.cell_halite/hlt::constants::MOVE_COST_RATIO;
+    if (move == STILL_INDEX || move_cost > state.halite) {
+        hlt::Halite mined = std::min(
+            ceil_div(state.cell_halite, hlt::constants::EXTRACT_RATIO),
+            hlt::constants::MAX_HALITE-state.halite);
+        state.halite += mined;
+        state.cell_halite -= mined;
+    } else {
+        state.halite -= move_cost;
+        state.position = neighbors[state.position*ALL_DIRECTIONS.size()+move];
+        state.cell_halite = original_halite[state.position];
+    }
+}
+
+uint64_t TranspositionTable::get_key(int ship_idx, const PathState& state) {
+    uint64_t key = ship_idx;
+    key = key*(MAX_DEPTH+1)+state.depth;
+    key = (key << 16)+state.position;
+    key = (key << 8)+state.halite/TRANSPOSITION_HALITE_STEP;
+    // 0 marks empty entries.
+    return key+1;
+}
+
+// Slots probed for a key before the table counts as full.
+const int MAX_PROBES = 16;
+
+NodeIndex TranspositionTable::find(int ship_idx, const PathState& state) const {
+    uint64_t key = get_key(ship_idx, state);
+    size_t mask = entries.size()-1;
+    size_t slot = std::hash<uint64_t>()(key*0x9e3779b97f4a7c15) & mask;
+    for (int probe=0; probe < MAX_PROBES; probe++) {
+        auto& entry = entries[(slot+probe) & mask];
+        uint64_t entry_key = entry.key.load(std::memory_order_relaxed);
+        if (entry_key == key) { return entry.node.load(std::memory_order_acquire); }
+        if (entry_key == 0) { return NO_NODE; }
+    }
+    return NO_NODE;
+}
+
+void TranspositionTable::insert(int ship_idx, const PathState& state, NodeIndex node_idx) {
+    uint64_t key = get_key(ship_idx, state);
+    size_t mask = entries.size()-1;
+    size_t slot = std::hash<uint64_t>()(key*0x9e3779b97f4a7c15) & mask;
+    for (int probe=0; probe < MAX_PROBES; probe++) {
+        auto& entry = entries[(slot+probe) & mask];
+        uint64_t expected = 0;
+        if (entry.key.compare_exchange_strong(expected, key, std::memory_order_relaxed)) {
+            // Until the node is stored, readers find NO_NODE for the key.
+            entry.node.store(node_idx, std::memory_order_release);
+            return;
+        }
+        if (expected == key) { return; }
+    }
+}
+
+MctsTree::MctsTree(
+    float comparison_score,
+    MctsNodePool& pool,
+    NodeIndex root,
+    const PathModel* path_model,
+    TranspositionTable* transpositions,
+    const PolicyTable* priors,
+    hlt::PlayerId player,
+    int start_position,
+    hlt::Halite start_halite,
+    bool rave_enabled
+)
+  : comparison_score(comparison_score),
+    pool(&pool),
+    root(root == NO_NODE ? pool.allocate(1) : root),
+    path_model(path_model),
+    transpositions(transpositions),
+    priors(priors),
+    player(player),
+    start_position(start_position),
+    start_halite(start_halite),
+    rave_enabled(rave_enabled),
+    halving_candidates(0),
+    halving_start_visits(),
+    halving_round_target(0),
+    halving_round_budget(0)
+{
+    assert(this->root != NO_NODE);
+}
+
+void MctsTree::start_halving() {
+    halving_candidates = (1 << ALL_DIRECTIONS.size())-1;
+    halving_start_visits = {};
+    add_root_visits(halving_start_visits);
+    halving_round_target = INT_MAX;
+    halving_round_budget = 0;
+}
+
+void MctsTree::set_halving_budget(int num_visits) {
+    halving_round_budget = std::max(1, num_visits/NUM_HALVING_ROUNDS);
+    halving_round_target = std::max(1, halving_round_budget/(int)ALL_DIRECTIONS.size());
+}
+
+void MctsTree::fix_root_move(int move) {
+    halving_candidates = 1 << move;
+    halving_round_target = INT_MAX;
+}
+
+int MctsTree::get_halving_choice() const {
+    NodeIndex first_child = (*pool)[root].first_child.load(std::memory_order_acquire);
+    int best_child = 0;
+    float best_reward = -1.0;
+    for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+        if (first_child < 0 || (halving_candidates & (1 << child_idx)) == 0) { continue; }
+        auto& child = (*pool)[first_child+child_idx];
+        if (child.visits.load(std::memory_order_relaxed) == 0) { continue; }
+        float reward = child.get_average_reward();
+        if (reward > best_reward) {
+            best_child = child_idx;
+            best_reward = reward;
+        }
+    }
+    return best_child;
+}
+
+int MctsTree::get_halving_child(NodeIndex first_child) {
+    while (true) {
+        int least_child = 0;
+        int least_visits = INT_MAX;
+        int num_candidates = 0;
+        for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+            if ((halving_candidates & (1 << child_idx)) == 0) { continue; }
+            num_candidates++;
+            int visits = (*pool)[first_child+child_idx].visits.load(std::memory_order_relaxed)
+                -halving_start_visits[child_idx];
+            if (visits < least_visits) {
+                least_child = child_idx;
+                least_visits = visits;
+            }
+        }
+        if (least_visits < halving_round_target || num_candidates == 1) { return least_child; }
+
+        // Keep the better half of the candidates, rounded up.
+        int num_kept = (num_candidates+1)/2;
+        int kept_candidates = 0;
+        for (int kept=0; kept < num_kept; kept++) {
+            int best_child = 0;
+            float best_reward = -1.0;
+            for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+                int bit = 1 << child_idx;
+                if ((halving_candidates & bit) == 0 || (kept_candidates & bit) != 0) { continue; }
+                float reward = (*pool)[first_child+child_idx].get_average_reward();
+                if (reward > best_reward) {
+                    best_child = child_idx;
+                    best_reward = reward;
+                }
+            }
+            kept_candidates |= 1 << best_child;
+        }
+        halving_candidates = kept_candidates;
+        halving_round_target += std::max(1, halving_round_budget/num_kept);
+    }
+}
+
+int MctsTree::get_root_visits() const {
+    return (*pool)[root].visits.load(std::memory_order_relaxed);
+}
+
+void MctsTree::add_root_visits(std::array<int, 5>& child_visits) const {
+    NodeIndex first_child = (*pool)[root].first_child.load(std::memory_order_acquire);
+    if (first_child < 0) { return; }
+    for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+        child_visits[child_idx] += (*pool)[first_child+child_idx].visits;
+    }
+}
+
+void MctsTree::add_next_visits(int move, std::array<int, 5>& child_visits) const {
+    NodeIndex child = pool->get_child(root, move);
+    if (child == NO_NODE) { return; }
+    NodeIndex first_child = (*pool)[child].first_child.load(std::memory_order_acquire);
+    if (first_child < 0) { return; }
+    for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+        child_visits[child_idx] += (*pool)[first_child+child_idx].visits;
+    }
+}
+
+void MctsTree::get_shape(std::vector<char>& visited, int& num_nodes, int& max_depth) const {
+    num_nodes = 0;
+    max_depth = 0;
+    // Pairs of node and depth.
+    std::vector<std::pair<NodeIndex, int>> stack = { { root, 0 } };
+    visited[root] = true;
+    while (!stack.empty()) {
+        auto node_depth = stack.back();
+        stack.pop_back();
+        auto& node = (*pool)[node_depth.first];
+        num_nodes++;
+        if (node.visits.load(std::memory_order_relaxed) > 0) {
+            max_depth = std::max(max_depth, node_depth.second);
+        }
+        NodeIndex first_child = node.first_child.load(std::memory_order_acquire);
+        if (first_child < 0) { continue; }
+        for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+            if (visited[first_child+child_idx]) { continue; }
+            visited[first_child+child_idx] = true;
+            stack.push_back({ first_child+child_idx, node_depth.second+1 });
+        }
+    }
+}
+
+int MctsTree::get_best_child(const MctsNode& node, NodeIndex first_child) const {
+    float best_score = -1.0;
+    int best_child = 0;
+    float log_visits = std::log(node.visits.load(std::memory_order_relaxed));
+    for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+        auto& child = (*pool)[first_child+child_idx];
+        int child_visits = child.visits.load(std::memory_order_relaxed);
+        // Another thread has expanded the node, but not updated the children yet.
+        if (child_visits == 0) { return child_idx; }
+
+        // Virtual losses count as visits without a reward.
+        float exploit = get_child_reward(child, child_visits, 0);
+        // Decreases when child is visited
+        float explore = std::sqrt(log_visits/child_visits);
+        float score = exploit+EXPLORATION_CONSTANT*explore;
+        // TODO why random choice when about equal?
+        if (score > best_score) {
+            best_child = child_idx;
+            best_score = score;
+        }
+    }
+    return best_child;
+}
+
+// PUCT as in AlphaZero. Unvisited children are valued at the average reward of the node, so that
+// the priors decide the order in which they are tried.
+int MctsTree::get_best_prior_child(const MctsNode& node, NodeIndex first_child) const {
+    int node_visits = node.visits.load(std::memory_order_relaxed);
+    float node_reward = node_visits > 0 ? node.get_average_reward() : 0.5;
+    float sqrt_visits = std::sqrt(std::max(1, node_visits));
+    float best_score = -1.0;
+    int best_child = 0;
+    for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+        auto& child = (*pool)[first_child+child_idx];
+        int child_visits = child.visits.load(std::memory_order_relaxed);
+        float exploit = get_child_reward(child, child_visits, node_reward);
+        float explore = child.prior*sqrt_visits/(1+child_visits);
+        float score = exploit+PRIOR_EXPLORATION_CONSTANT*explore;
+        if (score > best_score) {
+            best_child = child_idx;
+            best_score = score;
+        }
+    }
+    return best_child;
+}
+
+// The weight of the AMAF reward decreases with the child's own visits, as in Gelly and Silver's
+// RAVE schedule.
+float MctsTree::get_child_reward(
+    const MctsNode& child,
+    int child_visits,
+    float unvisited_reward
+) const {
+    float reward = child_visits > 0 ? child.get_average_reward() : unvisited_reward;
+    if (!rave_enabled) { return reward; }
+    int amaf_visits = child.amaf_visits.load(std::memory_order_relaxed);
+    if (amaf_visits == 0) { return reward; }
+    float amaf_weight = std::sqrt(RAVE_EQUIVALENCE/(3*child_visits+RAVE_EQUIVALENCE));
+    return (1-amaf_weight)*reward+amaf_weight*child.get_amaf_reward();
+}
+
+// function TREEPOLICY(v)
+//     while v is nonterminal do
+//         if v not fully expanded then
+//             return EXPAND(v)
+//         else
+//             v ← BESTCHILD(v, Cp)
+//     return v
+//
+void MctsTree::tree_policy(ShipMoves& moves, int ship_idx, int max_depth, int virtual_loss) {
+    moves.clear(ship_idx);
+    int horizon = std::min(max_depth, MAX_DEPTH);
+    NodeIndex node_idx = root;
+    PathState state = {};
+    if (path_model != nullptr) {
+        state = path_model->get_start_state(start_position, start_halite);
+    }
+    while (true) {
+        auto& node = (*pool)[node_idx];
+        if (virtual_loss != 0) { node.visits += virtual_loss; }
+
+        NodeIndex first_child = node.first_child.load(std::memory_order_acquire);
+        if (first_child < 0) {
+            expand(node_idx, ship_idx, state);
+            return;
+        }
+        // The children are the moves of the lanes, which are the last simulated moves at the
+        // horizon. Nodes below them would never be simulated.
+        if (moves.get_path_size(ship_idx) >= horizon-1) { return; }
+        int best_child = 0;
+        if (node_idx == root && halving_candidates != 0) {
+            best_child = get_halving_child(first_child);
+        } else if (priors != nullptr) {
+            best_child = get_best_prior_child(node, first_child);
+        } else {
+            best_child = get_best_child(node, first_child);
+        }
+        moves.push(ship_idx, best_child);
+        if (path_model != nullptr) { path_model->step(state, best_child); }
+        node_idx = first_child+best_child;
+    }
+}
+
+void MctsTree::expand(NodeIndex node_idx, int ship_idx, const PathState& state) {
+    float child_priors[5];
+    if (priors != nullptr) {
+        priors->get_priors(player, state.position, state.halite, state.cell_halite, child_priors);
+    }
+    const float* expand_priors = priors != nullptr ? child_priors : nullptr;
+
+    // The root is the only node at depth 0.
+    if (transpositions == nullptr || state.depth == 0) {
+        pool->expand(node_idx, expand_priors);
+        return;
+    }
+
+    NodeIndex transposition = transpositions->find(ship_idx, state);
+    if (transposition != NO_NODE) {
+        NodeIndex shared_children =
+            (*pool)[transposition].first_child.load(std::memory_order_acquire);
+        if (shared_children >= 0) {
+            NodeIndex expected = LEAF;
+            (*pool)[node_idx].first_child.compare_exchange_strong(
+                expected, shared_children, std::memory_order_release);
+            return;
+        }
+    }
+    pool->expand(node_idx, expand_priors);
+    if ((*pool)[node_idx].first_child.load(std::memory_order_acquire) >= 0) {
+        transpositions->insert(ship_idx, state, node_idx);
+    }
+}
+
+void MctsTree::remove_virtual_loss(const ShipMoves& moves, int ship_idx, int virtual_loss) {
+    NodeIndex node_idx = root;
+    for (int depth=0; ; depth++) {
+        auto& node = (*pool)[node_idx];
+        node.visits -= virtual_loss;
+        if (!moves.is_move_specified(ship_idx, depth)) { break; }
+        node_idx = node.first_child.load(std::memory_order_acquire)+moves.get_move(ship_idx, depth);
+    }
+}
+
+void MctsTree::update(const ShipMoves& moves, int ship_idx, float score) {
+    int points = DRAW_POINTS;
+    if (score > comparison_score) { points = WIN_POINTS; }
+    if (score < comparison_score) { points = LOSS_POINTS; }
+
+    // The moves taken at each depth or later, as bits.
+    int later_moves[MAX_DEPTH+2];
+    if (rave_enabled) {
+        int path_size = moves.get_path_size(ship_idx);
+        later_moves[path_size] = 0;
+        for (int depth=path_size-1; depth >= 0; depth--) {
+            later_moves[depth] = later_moves[depth+1] | (1 << moves.get_move(ship_idx, depth));
+        }
+    }
+
+    NodeIndex node_idx = root;
+    for (int depth=0; ; depth++) {
+        auto& node = (*pool)[node_idx];
+        node.visits.fetch_add(1, std::memory_order_relaxed);
+        node.reward_points.fetch_add(points, std::memory_order_relaxed);
+        if (!moves.is_move_specified(ship_idx, depth)) { break; }
+
+        NodeIndex first_child = node.first_child.load(std::memory_order_acquire);
+        // The node might still be expanded by another thread.
+        if (first_child < 0) { break; }
+        if (rave_enabled) {
+            for (size_t move = 0; move < ALL_DIRECTIONS.size(); move++) {
+                if ((later_moves[depth] & (1 << move)) == 0) { continue; }
+                auto& child = (*pool)[first_child+move];
+                child.amaf_visits.fetch_add(1, std::memory_order_relaxed);
+                child.amaf_reward_points.fetch_add(points, std::memory_order_relaxed);
+            }
+        }
+        node_idx = first_child+moves.get_move(ship_idx, depth);
+    }
+}
+
+void print_node(std::ostream& os, const MctsNodePool& pool, NodeIndex node_idx) {
+    auto& node = pool[node_idx];
+    os << "{ " << node.reward_points << "/" << WIN_POINTS*node.visits;
+    NodeIndex first_child = node.first_child;
+    if (first_child >= 0) {
+        os << " [";
+        for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+            os << " ";
+            print_node(os, pool, first_child+child_idx);
+        }
+        os << " ]";
+    }
+    os << " }";
+}
+
+std::ostream& operator<<(std::ostream& os, const MctsTree& tree) {
+    print_node(os, *tree.pool, tree.root);
+    return os;
+}
+
+hlt::Direction most_visited_move(const std::array<int, 5>& child_visits) {
+    int best_child = 0;
+    int best_visits = 0;
+    for (size_t child_idx = 0; child_idx < ALL_DIRECTIONS.size(); child_idx++) {
+        if (child_visits[child_idx] > best_visits) {
+            best_visits = child_visits[child_idx];
+            best_child = child_idx;
+        }
+    }
+#ifdef DEBUG
+    std::cerr << "best_move: " << best_child << ": " << best_visits << std::endl;
+#endif
+    return ALL_DIRECTIONS[best_child];
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include "bot/frame.hpp"
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+// Larger values will increase exploration, smaller will increase exploitation.
+const float EXPLORATION_CONSTANT = std::sqrt(2.0);
+// The same for selection guided by priors.
+const float PRIOR_EXPLORATION_CONSTANT = 1.0;
+// Number of visits at which a child's own reward and its AMAF reward weigh about the same.
+const float RAVE_EQUIVALENCE = 100;
+// Rounds of sequential halving, which search five, three and then two root moves. The move is
+// then picked from the remaining ones by reward.
+const int NUM_HALVING_ROUNDS = 3;
+
+// The maximum depth that moves will be generated for
+const int MAX_DEPTH = 50;
+
+// A container for moves that allows faster access than a vec of vecs
+struct ShipMoves {
+    int num_ships;
+    // Ships from this index on have no search tree, so they never have any moves.
+    int num_searched_ships;
+    // Set to -1 if all moves are counted. Otherwise only the specified ship has any moves.
+    int isolated_ship;
+    std::vector<int> num_moves;
+    std::vector<int> moves;
+    // Frozen ships keep their moves, and are not given the move of each lane after them.
+    std::vector<bool> frozen;
+
+    ShipMoves(int num_ships)
+      : ShipMoves(num_ships, num_ships)
+    {
+    }
+
+    ShipMoves(int num_ships, int num_searched_ships)
+      : num_ships(num_ships),
+        num_searched_ships(num_searched_ships),
+        isolated_ship(-1),
+        num_moves(num_ships),
+        moves(num_ships*(MAX_DEPTH+1)),
+        frozen(num_ships)
+    {
+    }
+
+    bool is_active(int ship_idx) const {
+        return ship_idx < num_searched_ships
+            && (isolated_ship == -1 || isolated_ship == ship_idx);
+    }
+
+    void isolate(int ship_idx) {
+        isolated_ship = ship_idx;
+    }
+
+    // Fix the moves of a ship to a single move.
+    void freeze(int ship_idx, int move) {
+        clear(ship_idx);
+        push(ship_idx, move);
+        frozen[ship_idx] = true;
+    }
+
+    void unfreeze(int ship_idx) {
+        clear(ship_idx);
+        frozen[ship_idx] = false;
+    }
+
+    bool is_frozen(int ship_idx) const {
+        return frozen[ship_idx];
+    }
+
+    int get_path_size(int ship_idx) const {
+        return is_active(ship_idx) ? num_moves[ship_idx] : 0;
+    }
+
+    bool is_move_specified(int ship_idx, int depth) const {
+        return is_active(ship_idx) ? (depth < num_moves[ship_idx]) : false;
+    }
+
+    int get_move(int ship_idx, int depth) const {
+        return moves[depth*num_ships+ship_idx];
+    }
+
+    void push_bounded(int ship_idx, int move, int bound) {
+        int depth = num_moves[ship_idx];
+        if (depth < bound) {
+            moves[depth*num_ships+ship_idx] = move;
+            num_moves[ship_idx]++;
+        }
+    }
+
+    void push(int ship_idx, int move) {
+        push_bounded(ship_idx, move, MAX_DEPTH);
+    }
+
+    void push_temp(int ship_idx, int move) {
+        push_bounded(ship_idx, move, MAX_DEPTH+1);
+    }
+
+    void pop(int ship_idx) {
+        num_moves[ship_idx]--;
+    }
+
+    void clear(int ship_idx) {
+        num_moves[ship_idx] = 0;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const ShipMoves& moves);
+};
+
+std::ostream& operator<<(std::ostream& os, const ShipMoves& moves);
+
+// Index of a node in a MctsNodePool.
+using NodeIndex = int;
+const NodeIndex NO_NODE = -1;
+// Values of MctsNode::first_child for nodes without children.
+const NodeIndex LEAF = -1;
+const NodeIndex EXPANDING = -2;
+
+// Rewards are stored as points to allow atomic integer updates.
+const int WIN_POINTS = 2;
+const int DRAW_POINTS = 1;
+const int LOSS_POINTS = 0;
+
+// The members are atomic so that several threads can search the same tree.
+struct MctsNode {
+    std::atomic<int> visits;
+    // Sum of the rewards in points.
+    std::atomic<int> reward_points;
+    // The children are stored in ALL_DIRECTIONS.size() consecutive slots starting at this index.
+    // Set to LEAF or EXPANDING if the children do not exist yet.
+    std::atomic<NodeIndex> first_child;
+    // Probability of the move leading to this node, as given by the priors of its parent when
+    // the children were created. Only written before the children are published.
+    float prior;
+    // All-moves-as-first statistics: the rollouts through the parent in which the move of this
+    // node was taken at the parent's depth or any later depth.
+    std::atomic<int> amaf_visits;
+    std::atomic<int> amaf_reward_points;
+
+    float get_average_reward() const;
+    float get_amaf_reward() const;
+};
+
+class PolicyTable;
+
+// Fixed size storage for the nodes of any number of trees. Allocated once, and cleared in
+// constant time between turns.
+class MctsNodePool {
+    std::vector<MctsNode> nodes;
+    std::atomic<NodeIndex> size;
+
+    // Scratch space of copy_subtree, kept between turns so that copying does not allocate.
+    // Pairs of source and copied node, in the order they were copied.
+    std::vector<std::pair<NodeIndex, NodeIndex>> copy_queue;
+    // The copy of the children starting at each source node, or NO_NODE if not copied yet.
+    std::vector<NodeIndex> copied_children;
+
+public:
+    MctsNodePool(int capacity);
+
+    MctsNode& operator[](NodeIndex idx) { return nodes[idx]; }
+    const MctsNode& operator[](NodeIndex idx) const { return nodes[idx]; }
+
+    // Remove all nodes.
+    void clear();
+    // Allocate consecutive empty nodes, returning the index of the first one.
+    // Returns NO_NODE if the pool is full.
+    NodeIndex allocate(int num_nodes);
+    // Create the children of a node, unless another thread already does or the pool is full.
+    // The children get the given priors for each move, or uniform priors if none are given.
+    void expand(NodeIndex node_idx, const float* priors=nullptr);
+    // Get a child of a node, or NO_NODE if the node has no children.
+    NodeIndex get_child(NodeIndex node_idx, int move) const;
+    // Copy the upper levels of a subtree from another pool, up to max_nodes nodes, and as far as
+    // this pool has room for them. Children shared between nodes stay shared.
+    // Returns the index of the new root, or NO_NODE if the pool is full.
+    NodeIndex copy_subtree(const MctsNodePool& source, NodeIndex source_root, int max_nodes);
+    // Number of allocated nodes.
+    int get_size() const;
+    int get_capacity() const;
+};
+
+// Steps of ship halite within which tree states are considered the same.
+const int TRANSPOSITION_HALITE_STEP = 100;
+
+// The state of a ship along a path of a tree, as far as the tree can tell without simulating the
+// other ships.
+struct PathState {
+    int depth;
+    int position;
+    hlt::Halite halite;
+    // Halite left in the cell, for ships that stay still more than once.
+    hlt::Halite cell_halite;
+};
+
+// Follows the state of a ship along the paths of its tree on the map of a frame.
+class PathModel {
+    // The position reached by each move from each position, indexed by position*5+move.
+    std::vector<int> neighbors;
+    std::vector<hlt::Halite> original_halite;
+
+public:
+    // Use the map of the frame.
+    void reset(const Frame& frame);
+
+    PathState get_start_state(int position, hlt::Halite halite) const;
+    // Apply a move in the same way as the simulation, ignoring other ships and inspiration.
+    void step(PathState& state, int move) const;
+};
+
+// Finds the nodes of the trees in a pool that are reached by different paths ending in the same
+// state, keyed by the ship, depth, cell and a step of ship halite. A leaf whose state already has
+// children elsewhere shares those children instead of allocating its own, which turns the trees
+// into graphs where transpositions share their statistics.
+//
+// Entries are inserted without locks, so that several threads can use the table.
+class TranspositionTable {
+    struct Entry {
+        // 0 for empty entries.
+        std::atomic<uint64_t> key;
+        std::atomic<NodeIndex> node;
+    };
+
+    std::vector<Entry> entries;
+
+public:
+    // The capacity is rounded up to a power of two.
+    TranspositionTable(int capacity);
+
+    // Remove all entries.
+    void reset();
+
+    // Get the node stored for the state of a ship, or NO_NODE if there is none.
+    NodeIndex find(int ship_idx, const PathState& state) const;
+    // Store a node for the state of a ship, unless one is already stored or the table is full.
+    void insert(int ship_idx, const PathState& state, NodeIndex node_idx);
+
+private:
+    static uint64_t get_key(int ship_idx, const PathState& state);
+};
+
+struct MctsTree {
+    // Scores to compare against. A score > this value is counted as a win, while less than this is
+    // a draw.
+    // Usually the previous average scores are compared against.
+    float comparison_score;
+
+    MctsNodePool* pool;
+    NodeIndex root;
+
+    // Set to nullptr if the states along the paths are not followed. Transpositions and priors
+    // need them.
+    const PathModel* path_model;
+    // Set to nullptr if transpositions are not shared.
+    TranspositionTable* transpositions;
+    // Set to nullptr to select children by plain UCT. Otherwise the children are created with
+    // the rollout policy of the ship's player as priors, and selected by PUCT.
+    const PolicyTable* priors;
+    // The ship at the root.
+    hlt::PlayerId player;
+    int start_position;
+    hlt::Halite start_halite;
+    // Whether selection blends in the AMAF rewards of the children, as in RAVE.
+    bool rave_enabled;
+
+    // Root moves that are still candidates of sequential halving, as bits. 0 if the root children
+    // are selected like all other nodes.
+    int halving_candidates;
+    // Visits of the root children when the halving started.
+    std::array<int, 5> halving_start_visits;
+    // Visits since the start that each candidate needs before the current round ends.
+    int halving_round_target;
+    // Visits of all candidates in each round. 0 until set_halving_budget is called.
+    int halving_round_budget;
+
+    // Continues from an existing root in the pool, or creates a new one if root is NO_NODE, for
+    // which the pool must have room.
+    MctsTree(
+        float comparison_score,
+        MctsNodePool& pool,
+        NodeIndex root=NO_NODE,
+        const PathModel* path_model=nullptr,
+        TranspositionTable* transpositions=nullptr,
+        const PolicyTable* priors=nullptr,
+        hlt::PlayerId player=0,
+        int start_position=0,
+        hlt::Halite start_halite=0,
+        bool rave_enabled=false);
+
+    int get_root_visits() const;
+    // Select the root children by sequential halving from now on. Until the budget is set, all
+    // root moves are visited in turn.
+    void start_halving();
+    // Split the visits that the root will get from the start of the halving between the rounds.
+    void set_halving_budget(int num_visits);
+    // Only search below the root child of the move, as if it were the last candidate of
+    // sequential halving.
+    void fix_root_move(int move);
+    // The remaining candidate of sequential halving with the best average reward.
+    int get_halving_choice() const;
+
+    // Add the visits of each root child to the given counts.
+    void add_root_visits(std::array<int, 5>& child_visits) const;
+    // Add the visits of each child of the root child of the move to the given counts.
+    void add_next_visits(int move, std::array<int, 5>& child_visits) const;
+    // Count the nodes below the root, and find the depth of the deepest visited one. visited has
+    // a flag for each node of the pool, which is set for the counted nodes, so that nodes shared
+    // by transpositions are counted once.
+    void get_shape(std::vector<char>& visited, int& num_nodes, int& max_depth) const;
+
+    // Sets the path in the moves struct instead of returning a newly allocated path.
+    // The path has at most max_depth-1 moves, so that the move of each lane after it is still
+    // simulated by rollouts of max_depth turns.
+    // Each node on the path receives virtual_loss visits, which steer other threads towards other
+    // paths until they are removed again by remove_virtual_loss.
+    void tree_policy(ShipMoves& moves, int ship_idx, int max_depth, int virtual_loss);
+
+    // Remove the virtual loss added by tree_policy along the path in moves.
+    void remove_virtual_loss(const ShipMoves& moves, int ship_idx, int virtual_loss);
+
+    // Update the tree using a score that does not need to be normalized.
+    void update(const ShipMoves& moves, int ship_idx, float score);
+
+    friend std::ostream& operator<<(std::ostream& os, const MctsTree& tree);
+
+private:
+    int get_best_child(const MctsNode& node, NodeIndex first_child) const;
+    int get_best_prior_child(const MctsNode& node, NodeIndex first_child) const;
+    // The candidate with the fewest visits in the current round, after ending the round if all
+    // candidates have reached the target.
+    int get_halving_child(NodeIndex first_child);
+    // The reward of a child for selection, or unvisited_reward if it has no visits.
+    float get_child_reward(const MctsNode& child, int child_visits, float unvisited_reward) const;
+    // Create the children of a leaf, or share those of a transposition.
+    void expand(NodeIndex node_idx, int ship_idx, const PathState& state);
+};
+
+std::ostream& operator<<(std::ostream& os, const MctsTree& tree);
+
+// Get the most visited move given the visits of each root child, possibly summed across trees.
+hlt::Direction most_visited_move(const std::array<int, 5>& child_visits);
@@ -0,0 +1,36 @@
+#include "bot/random.hpp"
+
+Rng::Rng(uint64_t seed) {
+    // Spread the seed over the state with splitmix64, as the state must not be all zeros.
+    for (auto& value : state) {
+        seed += 0x9e3779b97f4a7c15;
+        value = mix(seed);
+    }
+}
+
+Rng Rng::split() {
+    Rng stream = *this;
+    jump();
+    return stream;
+}
+
+void Rng::jump() {
+    const uint64_t JUMP[] = {
+        0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c
+    };
+
+    uint64_t jumped[4] = {};
+    for (auto jump_bits : JUMP) {
+        for (int bit=0; bit < 64; bit++) {
+            if (jump_bits & (uint64_t(1) << bit)) {
+                for (int i=0; i < 4; i++) {
+                    jumped[i] ^= state[i];
+                }
+            }
+            (*this)();
+        }
+    }
+    for (int i=0; i < 4; i++) {
+        state[i] = jumped[i];
+    }
+}
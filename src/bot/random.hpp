@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+// xoshiro256** random number generator. Faster than std::mt19937, with a much smaller state.
+//
+// split hands out streams that are 2^128 numbers apart, so that threads and simulation lanes can
+// each get their own stream from a single seed, and still give the same numbers on every run.
+//
+// Meets the requirements of a uniform random bit generator, so it can be used with the standard
+// distributions.
+class Rng {
+    uint64_t state[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64-k));
+    }
+
+public:
+    using result_type = uint64_t;
+
+    explicit Rng(uint64_t seed);
+
+    // Scramble a value with the splitmix64 finalizer. Gives a random number for each distinct
+    // value, for when the same number has to be found again from the same value.
+    static uint64_t mix(uint64_t value) {
+        value = (value ^ (value >> 30))*0xbf58476d1ce4e5b9;
+        value = (value ^ (value >> 27))*0x94d049bb133111eb;
+        return value ^ (value >> 31);
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()() {
+        uint64_t result = rotl(state[1]*5, 7)*9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // A generator for the next 2^128 numbers of this one, which skips past them.
+    Rng split();
+
+private:
+    // Advance by 2^128 numbers.
+    void jump();
+};
@@ -0,0 +1,55 @@
+#include "bot/turn_timer.hpp"
+#include "hlt/log.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+    void add_duration(std::deque<ms_duration>& history, ms_duration duration) {
+        history.push_back(std::max(duration, ms_duration::zero()));
+        if (history.size() > TURN_TIMER_HISTORY) { history.pop_front(); }
+    }
+
+    ms_duration get_longest(const std::deque<ms_duration>& history) {
+        if (history.empty()) { return ms_duration::zero(); }
+        return *std::max_element(history.begin(), history.end());
+    }
+
+    std::string to_ms_string(ms_duration duration) {
+        return std::to_string((int)duration.count());
+    }
+}
+
+TurnTimer::TurnTimer(std::chrono::milliseconds turn_limit, std::chrono::milliseconds safety_margin)
+  : turn_limit(turn_limit),
+    safety_margin(safety_margin)
+{
+}
+
+void TurnTimer::start_turn(time_point frame_start) {
+    this->frame_start = frame_start;
+}
+
+time_point TurnTimer::get_end_time() {
+    auto now = ms_clock::now();
+    ms_duration overrun = get_longest(overruns);
+    ms_duration emit_time = get_longest(emit_times);
+    auto reserved = std::chrono::duration_cast<time_point::duration>(
+        safety_margin+overrun+emit_time);
+    end_time = std::max(now, frame_start+turn_limit-reserved);
+
+    hlt::log::log("turn time: parse " + to_ms_string(now-frame_start)
+        + " ms, search " + to_ms_string(end_time-now)
+        + " ms, overrun " + to_ms_string(overrun)
+        + " ms, emit " + to_ms_string(emit_time) + " ms");
+    return end_time;
+}
+
+void TurnTimer::end_compute() {
+    commands_ready = ms_clock::now();
+}
+
+void TurnTimer::end_emit() {
+    add_duration(overruns, commands_ready-end_time);
+    add_duration(emit_times, ms_clock::now()-commands_ready);
+}
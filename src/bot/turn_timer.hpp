@@ -0,0 +1,46 @@
+#pragma once
+
+#include "bot/typedefs.hpp"
+
+#include <chrono>
+#include <deque>
+
+// Number of recent turns whose durations TurnTimer expects the next turn to repeat.
+const int TURN_TIMER_HISTORY = 20;
+
+using ms_duration = std::chrono::duration<double, std::milli>;
+
+// Sets the end time of each turn's search, from the time the frame arrived and the durations
+// measured in recent turns, so that the search can use all of the engine's turn limit that is
+// not needed for the rest of the turn.
+//
+// The parse time of the turn is known by the time the end time is set. The time left after the
+// search is split into the overrun, the time the bot takes to return its commands after the end
+// time, and the emit time, the time to send them. Both are taken as the longest of the recent
+// turns, so that the budget leaves room for their spikes and not only for their averages.
+class TurnTimer {
+    std::chrono::milliseconds turn_limit;
+    // Kept free of the turn limit on top of the measured durations.
+    std::chrono::milliseconds safety_margin;
+
+    time_point frame_start;
+    time_point end_time;
+    time_point commands_ready;
+
+    // The durations of recent turns, oldest first.
+    std::deque<ms_duration> overruns;
+    std::deque<ms_duration> emit_times;
+
+public:
+    TurnTimer(std::chrono::milliseconds turn_limit, std::chrono::milliseconds safety_margin);
+
+    // frame_start is the time at which the frame started arriving.
+    void start_turn(time_point frame_start);
+    // The end time for the search of this turn. Call after parsing the frame.
+    time_point get_end_time();
+    // Call when the commands have been computed.
+    void end_compute();
+    // Call when the commands have been sent. Turns whose commands are not sent are not measured,
+    // as they took too long to tell how long the next turns will take.
+    void end_emit();
+};
@@ -0,0 +1,168 @@
+#include "bot/watchdog.hpp"
+#include "hlt/constants.hpp"
+
+#include <iostream>
+
+std::vector<hlt::Command> get_fallback_commands(
+    const hlt::Game& game,
+    const std::unordered_map<hlt::EntityId, hlt::Direction>& planned_moves
+) {
+    std::unordered_map<hlt::EntityId, hlt::Direction> moves;
+    for (auto& id_ship : game.me->ships) {
+        auto ship = id_ship.second;
+        auto it = planned_moves.find(ship->id);
+        auto move = it == planned_moves.end() ? hlt::Direction::STILL : it->second;
+        auto cell_halite = game.game_map->at(ship->position)->halite;
+        if (cell_halite/hlt::constants::MOVE_COST_RATIO > ship->halite) {
+            move = hlt::Direction::STILL;
+        }
+        moves[ship->id] = move;
+    }
+
+    // Stop the moving ships that share their cell with another ship, until none do. Each ship
+    // that stops can only take back its own cell, so this ends after at most one pass per ship.
+    bool is_changed = true;
+    while (is_changed) {
+        is_changed = false;
+        std::unordered_map<hlt::Position, int> num_ships_in_cell;
+        for (auto& id_ship : game.me->ships) {
+            auto ship = id_ship.second;
+            auto target = game.game_map->normalize(
+                ship->position.directional_offset(moves[ship->id]));
+            num_ships_in_cell[target]++;
+        }
+        for (auto& id_ship : game.me->ships) {
+            auto ship = id_ship.second;
+            if (moves[ship->id] == hlt::Direction::STILL) { continue; }
+            auto target = game.game_map->normalize(
+                ship->position.directional_offset(moves[ship->id]));
+            if (num_ships_in_cell[target] > 1) {
+                moves[ship->id] = hlt::Direction::STILL;
+                is_changed = true;
+            }
+        }
+    }
+
+    std::vector<hlt::Command> commands;
+    for (auto& id_ship : game.me->ships) {
+        commands.push_back(id_ship.second->move(moves[id_ship.first]));
+    }
+    return commands;
+}
+
+Watchdog::Watchdog(hlt::Game& game, std::chrono::milliseconds deadline_offset)
+  : game(game),
+    deadline_offset(deadline_offset),
+    input(std::cin.rdbuf()),
+    is_stopped(false),
+    is_input_closed(false),
+    num_started(0),
+    num_answered(0)
+{
+    std::cin.rdbuf(this);
+    reader_thread = std::thread([this]() { read_input(); });
+    deadline_thread = std::thread([this]() { watch_deadlines(); });
+}
+
+Watchdog::~Watchdog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_stopped = true;
+    }
+    condition.notify_all();
+    deadline_thread.join();
+    // Ends when the engine closes the input, which it does at the end of the game.
+    reader_thread.join();
+    std::cin.rdbuf(input);
+}
+
+bool Watchdog::start_turn() {
+    std::lock_guard<std::mutex> lock(mutex);
+    num_started++;
+    fallback_commands.clear();
+    return num_answered < num_started;
+}
+
+time_point Watchdog::get_frame_start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frame_starts[num_started-1];
+}
+
+void Watchdog::set_fallback_commands(std::vector<hlt::Command> commands) {
+    std::lock_guard<std::mutex> lock(mutex);
+    fallback_commands = std::move(commands);
+}
+
+bool Watchdog::send(const std::vector<hlt::Command>& commands) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (num_answered >= num_started) { return false; }
+        game.end_turn(commands);
+        num_answered++;
+    }
+    condition.notify_all();
+    return true;
+}
+
+void Watchdog::set_input_closed_handler(std::function<void()> handler) {
+    input_closed_handler = std::move(handler);
+}
+
+Watchdog::int_type Watchdog::underflow() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this]() { return !pending_input.empty() || is_input_closed; });
+    if (pending_input.empty()) {
+        lock.unlock();
+        if (input_closed_handler) { input_closed_handler(); }
+        return traits_type::eof();
+    }
+    current_input.swap(pending_input);
+    pending_input.clear();
+    char* start = &current_input[0];
+    setg(start, start, start+current_input.size());
+    return traits_type::to_int_type(*start);
+}
+
+void Watchdog::read_input() {
+    std::istream stream(input);
+    std::string line;
+    while (std::getline(stream, line)) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // The engine sends the next frame only after it has the commands of the last one.
+            if (num_answered == frame_starts.size()) {
+                frame_starts.push_back(ms_clock::now());
+            }
+            pending_input += line;
+            pending_input += '\n';
+        }
+        condition.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_input_closed = true;
+    }
+    condition.notify_all();
+}
+
+void Watchdog::watch_deadlines() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!is_stopped) {
+        if (num_answered == frame_starts.size()) {
+            condition.wait(lock);
+            continue;
+        }
+        auto deadline = frame_starts[num_answered]+deadline_offset;
+        if (ms_clock::now() < deadline) {
+            condition.wait_until(lock, deadline);
+            continue;
+        }
+        // Without a fallback for the frame, the bot has not parsed it yet.
+        if (num_answered+1 == num_started) {
+            game.end_turn(fallback_commands);
+        } else {
+            game.end_turn({});
+        }
+        num_answered++;
+    }
+}
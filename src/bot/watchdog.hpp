@@ -0,0 +1,90 @@
+#pragma once
+
+#include "bot/typedefs.hpp"
+#include "hlt/command.hpp"
+#include "hlt/direction.hpp"
+#include "hlt/game.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Commands that are safe to send without searching: each own ship takes its planned move, or
+// stays still if it has none, can not pay for the move, or would end up in the same cell as
+// another own ship. Ships that stay still claim their cell first, so that moving ships give way
+// to them. No ship is spawned.
+std::vector<hlt::Command> get_fallback_commands(
+    const hlt::Game& game,
+    const std::unordered_map<hlt::EntityId, hlt::Direction>& planned_moves
+);
+
+// Guarantees that commands are sent for every frame by a hard deadline after it arrives, so that
+// a turn which takes too long does not get the bot ejected.
+//
+// A thread reads the input as it arrives, and passes it on to std::cin, of which the watchdog is
+// the buffer. Any input after the commands of a frame have been sent starts the next frame. If
+// the bot has not sent its commands by the deadline, another thread sends the fallback commands
+// of the turn, or no commands at all if the bot has not parsed the frame yet, which keeps all
+// ships still. The bot then drops the commands it computes for the turn, and skips the frames
+// that have been answered while it was busy.
+class Watchdog : public std::streambuf {
+    hlt::Game& game;
+    // Time after the start of a frame by which its commands are sent.
+    std::chrono::milliseconds deadline_offset;
+    // The buffer that std::cin read from before the watchdog.
+    std::streambuf* input;
+    std::thread reader_thread;
+    std::thread deadline_thread;
+    // Guards the members below.
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool is_stopped;
+
+    // Input that has been read but not passed on to std::cin yet.
+    std::string pending_input;
+    // Input being read by std::cin.
+    std::string current_input;
+    bool is_input_closed;
+
+    // When each frame since the watchdog started arrived.
+    std::vector<time_point> frame_starts;
+    // Number of frames that the bot has started its turn for.
+    size_t num_started;
+    // Number of frames whose commands have been sent, by the bot or by the watchdog.
+    size_t num_answered;
+    // The fallback commands of the last frame that the bot has started.
+    std::vector<hlt::Command> fallback_commands;
+    // Called when std::cin reaches the end of the input.
+    std::function<void()> input_closed_handler;
+
+public:
+    // Reads the input from now on, so the game must have been initialized.
+    Watchdog(hlt::Game& game, std::chrono::milliseconds deadline_offset);
+    ~Watchdog();
+
+    // Call after parsing a frame. Returns false if its commands have been sent already, in
+    // which case the turn should be skipped.
+    bool start_turn();
+    // When the frame of the current turn started arriving.
+    time_point get_frame_start();
+    // The commands to send if the current turn misses the deadline.
+    void set_fallback_commands(std::vector<hlt::Command> commands);
+    // Send the commands of the current turn. Returns false if the fallback commands have been
+    // sent instead.
+    bool send(const std::vector<hlt::Command>& commands);
+    // Called on the thread reading std::cin when it reaches the end of the input, after which the
+    // game exits the process without returning from main.
+    void set_input_closed_handler(std::function<void()> handler);
+
+protected:
+    int_type underflow() override;
+
+private:
+    void read_input();
+    void watch_deadlines();
+};
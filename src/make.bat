@@ -52,6 +52,12 @@ cl.exe /FeMyBot.exe /std:c++14 /O2 /MT /EHsc /I . /Fo.\obj\ ^
  .\bot\game_clone.cpp ^
  .\bot\plan.cpp ^
  .\bot\mcts.cpp ^
+ .\bot\mcts_tree.cpp ^
+ .\bot\mcts_simulation.cpp ^
+ .\bot\inspiration.cpp ^
+ .\bot\random.cpp ^
+ .\bot\turn_timer.cpp ^
+ .\bot\watchdog.cpp ^
  .\bot\math.cpp ^
  .\bot\gravity_grid.cpp ^
  .\bot\gravitybot.cpp ^
\ No newline at end of file